@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+// Stream buffer that discards everything, so benchmarks measure formatting without terminal I/O
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+// Collects latency samples and reports percentiles over them
+class LatencyRecorder {
+public:
+    void reserve(std::size_t count) { samples_.reserve(count); }
+    void record(std::chrono::nanoseconds latency) {
+        samples_.push_back(latency.count());
+        sorted_ = false;
+    }
+
+    // Fold in samples collected elsewhere, e.g. by another thread
+    void merge(const LatencyRecorder& other) {
+        samples_.insert(samples_.end(), other.samples_.begin(), other.samples_.end());
+        sorted_ = samples_.size() <= 1;
+    }
+
+    std::size_t count() const { return samples_.size(); }
+
+    std::int64_t percentile(double fraction) {
+        if (samples_.empty()) {
+            return 0;
+        }
+        if (!sorted_) {
+            std::sort(samples_.begin(), samples_.end());
+            sorted_ = true;
+        }
+        auto rank = static_cast<std::size_t>(fraction * static_cast<double>(samples_.size()));
+        return samples_[std::min(rank, samples_.size() - 1)];
+    }
+
+private:
+    std::vector<std::int64_t> samples_;
+    bool sorted_ = true;
+};
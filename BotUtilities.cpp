@@ -2,47 +2,20 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <future>
 #include <thread>
-#include <mutex>
 #include <memory>
 #include <iomanip>
 #include <sstream>
+#include <cstdlib>
 #include <nlohmann/json.hpp>
-#include <curl/curl.h>
+#include "ConfigWatcher.h"
+#include "HttpClient.h"
+#include "Logger.h"
+#include "RequestScheduler.h"
+#include "StartupProfile.h"
 
 using json = nlohmann::json;
-std::mutex io_mutex;
-
-// A class for handling HTTP requests
-class HttpClient {
-public:
-    HttpClient() {
-        curl_global_init(CURL_GLOBAL_DEFAULT);
-        curl_handle = curl_easy_init();
-    }
-
-    ~HttpClient() {
-        curl_easy_cleanup(curl_handle);
-        curl_global_cleanup();
-    }
-
-    std::string get(const std::string& url) {
-        curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &response_);
-        curl_easy_perform(curl_handle);
-        return response_;
-    }
-
-private:
-    CURL* curl_handle;
-    std::string response_;
-
-    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-        ((std::string*)userp)->append((char*)contents, size * nmemb);
-        return size * nmemb;
-    }
-};
 
 // A function to read configuration from a JSON file
 json readConfig(const std::string& filename) {
@@ -56,80 +29,135 @@ json readConfig(const std::string& filename) {
     return config;
 }
 
-// A class representing a logger
-class Logger {
-public:
-    enum class Level {
-        INFO,
-        WARNING,
-        ERROR
-    };
-
-    Logger(const std::string& filename) : log_file_(filename, std::ios::out | std::ios::app) {
-        if (!log_file_.is_open()) {
-            throw std::runtime_error("Could not open log file");
-        }
+// Why body is not valid JSON, or empty if it is. Only validated, so nothing is built from it.
+std::string jsonErrorOf(std::string_view body) {
+    JsonHandler validateOnly;
+    JsonStreamParser parser(validateOnly);
+    if (parser.feed(body)) {
+        parser.finish();
     }
+    return parser.error();
+}
 
-    void log(const std::string& message, Level level = Level::INFO) {
-        std::lock_guard<std::mutex> lock(io_mutex);
-        log_file_ << "[" << currentDateTime() << "] [" << levelToString(level) << "] " << message << std::endl;
+// Log how an API call went. Responses are checked in pollApis, so a failed parse shows up as
+// result.jsonError.
+void logApiResult(const std::string& url, const HttpResult& result, Logger& logger) {
+    if (!result.ok() && result.jsonError.empty()) {
+        logger.log<LogLevel::ERROR>("API call failed", {{"url", url}, {"error", result.error}});
+        return;
     }
+    if (result.jsonError.empty()) {
+        logger.log<LogLevel::INFO>("API call finished",
+                                   {{"url", url}, {"status", result.status}, {"seconds", result.seconds}, {"cached", result.fromCache}});
+    } else {
+        logger.log<LogLevel::ERROR>("Failed to parse JSON response",
+                                    {{"url", url}, {"status", result.status}, {"seconds", result.seconds}, {"error", result.jsonError}});
+    }
+}
 
-private:
-    std::ofstream log_file_;
+// Per-host budgets from config: "default_rate_limit" and "rate_limits", keyed by
+// scheme://host[:port], each {"per_second": N, "burst": N}
+RateLimit rateLimitFrom(const json& limit) {
+    RateLimit rateLimit;
+    rateLimit.perSecond = limit.value("per_second", 0.0);
+    rateLimit.burst = limit.value("burst", 1.0);
+    return rateLimit;
+}
 
-    std::string levelToString(Level level) const {
-        switch (level) {
-            case Level::INFO: return "INFO";
-            case Level::WARNING: return "WARNING";
-            case Level::ERROR: return "ERROR";
-            default: return "UNKNOWN";
+void applyRateLimits(const json& config, RequestScheduler& scheduler) {
+    if (config.contains("rate_limits")) {
+        for (const auto& [host, limit] : config["rate_limits"].items()) {
+            scheduler.setLimit(host, rateLimitFrom(limit));
         }
     }
+}
 
-    std::string currentDateTime() const {
-        std::time_t now = std::time(nullptr);
-        std::tm tm;
-        localtime_s(&tm, &now);
-        std::ostringstream oss;
-        oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
+// Call every URL in config["api_urls"] once and log the results in config order. Calls are
+// admitted by the scheduler as each host's budget allows, as background polls, then run
+// concurrently on the client's event-loop thread, a few at a time per host. Responses go
+// through the client's cache, so an unchanged one is revalidated rather than downloaded, and
+// is validated as JSON only the first time it is seen.
+void pollApis(const json& config, RequestScheduler& scheduler, AsyncHttpClient& client, Logger& logger) {
+    std::vector<std::string> urls = config["api_urls"];
+    std::vector<std::future<HttpResult>> results;
+    results.reserve(urls.size());
+    for (const auto& url : urls) {
+        auto promise = std::make_shared<std::promise<HttpResult>>();
+        results.push_back(promise->get_future());
+        std::string host = http::hostKey(url);
+        scheduler.schedule(host, RequestPriority::BACKGROUND, [&, url, host, promise](bool admitted) {
+            if (!admitted) {
+                HttpResult result;
+                result.code = CURLE_ABORTED_BY_CALLBACK;
+                result.error = "request scheduler shut down";
+                promise->set_value(std::move(result));
+                return;
+            }
+            client.getCached(url, [&scheduler, host, promise](HttpResult&& result) {
+                // Over the limit after all: hold the host back for as long as it asked
+                if (result.status == 429 || (result.status == 503 && result.retryAfterSeconds > 0)) {
+                    scheduler.pause(host, std::chrono::seconds(std::max(1L, result.retryAfterSeconds)));
+                }
+                if (result.entry) {
+                    result.jsonError = *result.entry->parsed<std::string>(jsonErrorOf);
+                }
+                promise->set_value(std::move(result));
+            });
+        });
     }
-};
-
-// A thread-safe function to perform an API call and log the response time
-void performApiCallAndLog(const std::string& url, Logger& logger) {
-    HttpClient client;
-    auto start = std::chrono::high_resolution_clock::now();
-    std::string response = client.get(url);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-
-    std::lock_guard<std::mutex> lock(io_mutex);
-    logger.log("API call to " + url + " took " + std::to_string(elapsed.count()) + " seconds", Logger::Level::INFO);
-
-    // Parse JSON response (just a dummy parse to show complexity)
-    try {
-        auto json_response = json::parse(response);
-        logger.log("Parsed JSON response successfully.", Logger::Level::INFO);
-    } catch (const std::exception& e) {
-        logger.log("Failed to parse JSON response: " + std::string(e.what()), Logger::Level::ERROR);
+    for (std::size_t i = 0; i < urls.size(); ++i) {
+        logApiResult(urls[i], results[i].get(), logger);
     }
 }
 
 int main() {
     try {
+        // libcurl is initialized once, before any requests start
+        HttpShare::instance();
         Logger logger("bot.log");
-        json config = readConfig("config.json");
-
-        std::vector<std::string> urls = config["api_urls"];
-        std::vector<std::thread> threads;
-        for (const auto& url : urls) {
-            threads.emplace_back(performApiCallAndLog, url, std::ref(logger));
+        // Edits to config.json are picked up while running; each poll round uses the snapshot
+        // it started with
+        ConfigWatcher<json> configWatcher("config.json", readConfig);
+        std::shared_ptr<const json> startup = configWatcher.snapshot();
+        const json& config = *startup;
+
+        // Per-endpoint latency histograms, scraped from 127.0.0.1:metrics_port and/or dumped to
+        // metrics_file every metrics_interval_ms and at exit
+        HttpMetrics metrics;
+        std::unique_ptr<MetricsServer> metricsServer;
+        std::unique_ptr<MetricsDumper> metricsDumper;
+        if (config.contains("metrics_port")) {
+            metricsServer = std::make_unique<MetricsServer>(metrics, config["metrics_port"].get<int>());
+            std::cout << "Serving metrics on http://127.0.0.1:" << metricsServer->port() << "/metrics" << std::endl;
+        }
+        if (config.contains("metrics_file")) {
+            metricsDumper = std::make_unique<MetricsDumper>(metrics, config["metrics_file"].get<std::string>(),
+                                                            std::chrono::milliseconds(config.value("metrics_interval_ms", 10000)));
         }
-        for (auto& thread : threads) {
-            thread.join();
+
+        // Polled responses are revalidated instead of downloaded again while unchanged; with
+        // http_cache_dir set the cache survives restarts
+        HttpCacheOptions cacheOptions;
+        cacheOptions.directory = config.value("http_cache_dir", std::string());
+        HttpCache cache(cacheOptions);
+
+        AsyncHttpOptions options;
+        options.http.metrics = &metrics;
+        options.http.cache = &cache;
+        AsyncHttpClient client(options);
+        RequestScheduler scheduler(rateLimitFrom(config.value("default_rate_limit", json::object())));
+        applyRateLimits(config, scheduler);
+        pollApis(config, scheduler, client, logger);
+        StartupProfile::instance().print(std::cout);
+
+        // With poll_interval_ms set, keep polling on the same warm connections; api_urls and the
+        // interval can be changed in config.json without a restart
+        std::shared_ptr<const json> current = startup;
+        while (current->contains("poll_interval_ms")) {
+            std::this_thread::sleep_for(std::chrono::milliseconds((*current)["poll_interval_ms"].get<long>()));
+            current = configWatcher.snapshot();
+            applyRateLimits(*current, scheduler);
+            pollApis(*current, scheduler, client, logger);
         }
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Keeps a parsed config file current. A background thread watches the file (inotify on Linux,
+// a once-a-second mtime check elsewhere), re-parses it when it changes and publishes the result
+// as a new immutable snapshot. Readers take snapshot() without locking while the config is
+// unchanged and keep using the one they took for as long as they hold it. A file that fails to
+// parse is reported on stderr and the previous snapshot stays in place.
+template <typename T>
+class ConfigWatcher {
+public:
+    using Loader = std::function<T(const std::string& path)>;
+
+    // Loads path once up front; a failure there throws, as nothing could be published
+    ConfigWatcher(std::string path, Loader load) : path_(std::move(path)), load_(std::move(load)) {
+        current_ = std::make_shared<const T>(load_(path_));
+        version_.store(1, std::memory_order_release);
+#ifdef __linux__
+        // Watch the directory rather than the file: editors and deploy tools usually replace
+        // the file by renaming a new one over it, which ends a watch on the file itself
+        std::size_t slash = path_.rfind('/');
+        directory_ = slash == std::string::npos ? "." : path_.substr(0, slash == 0 ? 1 : slash);
+        name_ = slash == std::string::npos ? path_ : path_.substr(slash + 1);
+        inotifyFd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd_ < 0 ||
+            ::inotify_add_watch(inotifyFd_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            if (inotifyFd_ >= 0) {
+                ::close(inotifyFd_);
+            }
+            throw std::runtime_error("Could not watch " + directory_ + " for config changes");
+        }
+#else
+        modified_ = modificationTime();
+#endif
+        thread_ = std::thread(&ConfigWatcher::watch, this);
+    }
+
+    ~ConfigWatcher() {
+        stop_.store(true);
+        thread_.join();
+#ifdef __linux__
+        ::close(inotifyFd_);
+#endif
+    }
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    // The latest snapshot. Each thread caches the last one it took and only compares an atomic
+    // version number with it, so while the config is unchanged this is one atomic load and a
+    // reference count increment. The first call after a reload takes the new snapshot under a
+    // short lock; libstdc++'s std::atomic<std::shared_ptr> would lock there too. The cache only
+    // holds a weak reference, so it never keeps a destroyed watcher's config alive.
+    std::shared_ptr<const T> snapshot() const {
+        thread_local std::uint64_t cachedInstance = 0;
+        thread_local std::uint64_t cachedVersion = 0;
+        thread_local std::weak_ptr<const T> cached;
+        std::uint64_t version = version_.load(std::memory_order_acquire);
+        if (cachedInstance == instance_ && cachedVersion == version) {
+            if (std::shared_ptr<const T> snapshot = cached.lock()) {
+                return snapshot;
+            }
+        }
+        std::lock_guard<std::mutex> lock(currentMutex_);
+        cached = current_;
+        cachedInstance = instance_;
+        cachedVersion = version;
+        return current_;
+    }
+
+    // Starts at 1 and goes up by one for every reload that published a new snapshot
+    std::uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    // Re-read the file now instead of waiting for the watcher
+    bool reload() {
+        try {
+            auto next = std::make_shared<const T>(load_(path_));
+            {
+                std::lock_guard<std::mutex> lock(currentMutex_);
+                current_ = std::move(next);
+            }
+            version_.fetch_add(1, std::memory_order_acq_rel);
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Keeping previous config, could not reload " << path_ << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+private:
+    static inline std::atomic<std::uint64_t> nextInstance_{1};
+
+    std::string path_;
+    Loader load_;
+    std::uint64_t instance_ = nextInstance_.fetch_add(1);
+    mutable std::mutex currentMutex_;
+    std::shared_ptr<const T> current_;
+    std::atomic<std::uint64_t> version_{0}; // bumped after current_ changes
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+#ifdef __linux__
+    std::string directory_;
+    std::string name_;
+    int inotifyFd_ = -1;
+#else
+    std::int64_t modified_ = 0;
+
+    std::int64_t modificationTime() const {
+        struct stat status{};
+        return ::stat(path_.c_str(), &status) == 0 ? static_cast<std::int64_t>(status.st_mtime) : 0;
+    }
+#endif
+
+    void watch() {
+        while (!stop_.load()) {
+#ifdef __linux__
+            pollfd watched{inotifyFd_, POLLIN, 0};
+            if (::poll(&watched, 1, 200) <= 0 || !drainEvents()) {
+                continue;
+            }
+            // Writers often touch the file more than once in quick succession; let them finish
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            drainEvents();
+            reload();
+#else
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            std::int64_t modified = modificationTime();
+            if (modified != 0 && modified != modified_) {
+                modified_ = modified;
+                reload();
+            }
+#endif
+        }
+    }
+
+#ifdef __linux__
+    // Read all queued events; returns whether any of them was about the config file
+    bool drainEvents() {
+        alignas(inotify_event) char buffer[4096];
+        bool relevant = false;
+        for (;;) {
+            ssize_t length = ::read(inotifyFd_, buffer, sizeof(buffer));
+            if (length <= 0) {
+                return relevant;
+            }
+            for (char* at = buffer; at < buffer + length;) {
+                auto* event = reinterpret_cast<inotify_event*>(at);
+                if (event->len > 0 && name_ == event->name) {
+                    relevant = true;
+                }
+                at += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+};
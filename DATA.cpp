@@ -1,52 +1,11 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <fstream>
 #include <thread>
-#include <mutex>
 #include <memory>
-#include <ctime>
-#include <sstream>
-#include <iomanip>
-
-// A class to manage data recording
-class DataRecorder {
-public:
-    DataRecorder(const std::string& filename) : filename_(filename) {
-        // Open the file in append mode
-        file_.open(filename_, std::ios::out | std::ios::app);
-        if (!file_.is_open()) {
-            throw std::runtime_error("Could not open file for recording data");
-        }
-    }
-
-    ~DataRecorder() {
-        if (file_.is_open()) {
-            file_.close();
-        }
-    }
-
-    void recordData(const std::string& data) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::string timestampedData = getCurrentTimestamp() + " - " + data;
-        file_ << timestampedData << std::endl;
-        std::cout << "Recorded: " << timestampedData << std::endl;
-    }
-
-private:
-    std::ofstream file_;
-    std::string filename_;
-    std::mutex mutex_;
-
-    std::string getCurrentTimestamp() const {
-        auto now = std::chrono::system_clock::now();
-        auto in_time_t = std::chrono::system_clock::to_time_t(now);
-
-        std::stringstream ss;
-        ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
-        return ss.str();
-    }
-};
+#include <future>
+#include "DataRecorder.h"
+#include "ThreadPool.h"
 
 // Function to simulate data recording
 void simulateDataRecording(DataRecorder& recorder, const std::vector<std::string>& dataEntries) {
@@ -55,9 +14,55 @@ void simulateDataRecording(DataRecorder& recorder, const std::vector<std::string
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        DataRecorder recorder("data.log");
+        // --async records through the lock-free ring and background writer (--per-thread gives
+        // each producer thread a ring of its own), --binary writes binary records to data.bin for
+        // ve-logcat, --segment-bytes N rotates to a new segment every N bytes (--compress
+        // compresses closed segments in the background) and --sync-ms N group-commits the log
+        // to disk every N milliseconds
+        bool async = false;
+        bool perThread = false;
+        bool binary = false;
+        SegmentOptions segments;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--async") {
+                async = true;
+            } else if (arg == "--per-thread") {
+                async = true;
+                perThread = true;
+            } else if (arg == "--binary") {
+                binary = true;
+            } else if (arg == "--segment-bytes" && i + 1 < argc) {
+                segments.maxBytes = std::stoull(argv[++i]);
+                segments.preallocateBytes = segments.maxBytes;
+            } else if (arg == "--compress") {
+                segments.compressClosed = true;
+            } else if (arg == "--sync-ms" && i + 1 < argc) {
+                segments.syncInterval = std::chrono::milliseconds(std::stoll(argv[++i]));
+            } else {
+                throw std::invalid_argument("Unknown option " + arg);
+            }
+        }
+        RecordFormat format = binary ? RecordFormat::BINARY : RecordFormat::TEXT;
+        std::string filename = binary ? "data.bin" : "data.log";
+        std::unique_ptr<DataRecorder> recorder;
+        if (async) {
+            AsyncOptions options;
+            options.echo = !binary;
+            options.format = format;
+            if (perThread) {
+                options.buffering = AsyncBuffering::PER_THREAD;
+            }
+            recorder = std::make_unique<DataRecorder>(filename, options, segments);
+        } else {
+            recorder = std::make_unique<DataRecorder>(filename, format, segments);
+        }
+        // Keep the latest records in memory, so a crash prints what led up to it
+        auto recentRecords = std::make_shared<MemoryRingSink>(64 * 1024);
+        recentRecords->installCrashHandler();
+        recorder->addSink(recentRecords);
 
         // List of data entries for simulation
         std::vector<std::string> dataEntries = {
@@ -69,18 +74,19 @@ int main() {
         };
 
         // Simulate data recording in multiple threads
-        std::vector<std::thread> threads;
+        std::vector<std::future<void>> tasks;
         for (int i = 0; i < 3; ++i) {
-            threads.emplace_back(simulateDataRecording, std::ref(recorder), std::ref(dataEntries));
+            tasks.push_back(ThreadPool::shared().submit(simulateDataRecording, std::ref(*recorder), std::ref(dataEntries)));
         }
 
-        for (auto& thread : threads) {
-            thread.join();
+        for (auto& task : tasks) {
+            task.get();
         }
+        recorder->waitDurable();
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
         return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
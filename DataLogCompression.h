@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Compressed form of a closed DataRecorder log segment, <segment>.lz, which replaces the segment.
+//
+// Layout (native little-endian):
+//   CompressedLogHeader
+//   block data            each block of up to blockBytes of the original, compressed on its own
+//   CompressedLogBlock[]  block index, in order
+//   CompressedLogFooter
+//
+// Blocks decode independently, so a reader seeks to any offset of the original by inflating
+// only the block that holds it. Offsets in the segment's .idx time index keep referring to the
+// original bytes and stay valid. Blocks that would not shrink are stored as they are.
+//
+// The block codec is a byte-oriented LZ77 in the style of LZ4: a sequence is a token byte
+// (literal count in the high nibble, match length - 4 in the low one, 15 meaning more length
+// bytes follow), the literals, then a 16-bit back offset and any extra match length bytes.
+// The final sequence carries literals only.
+
+struct CompressedLogHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t blockBytes;
+};
+
+struct CompressedLogBlock {
+    std::uint64_t rawOffset; // where the block starts in the original
+    std::uint64_t offset;    // where its data starts in the compressed file
+    std::uint32_t rawLength;
+    std::uint32_t length;    // equal to rawLength when stored uncompressed
+};
+
+struct CompressedLogFooter {
+    std::uint64_t indexOffset;
+    std::uint64_t blocks;
+    std::uint64_t rawSize;
+    char magic[8];
+};
+
+static_assert(sizeof(CompressedLogHeader) == 16, "CompressedLogHeader layout is part of the file format");
+static_assert(sizeof(CompressedLogBlock) == 24, "CompressedLogBlock layout is part of the file format");
+static_assert(sizeof(CompressedLogFooter) == 32, "CompressedLogFooter layout is part of the file format");
+
+constexpr char kCompressedLogMagic[8] = {'V', 'E', 'L', 'O', 'G', 'L', 'Z', '1'};
+constexpr char kCompressedLogEndMagic[8] = {'V', 'E', 'L', 'Z', 'E', 'N', 'D', '1'};
+constexpr std::uint32_t kCompressedLogVersion = 1;
+constexpr const char* kCompressedLogSuffix = ".lz";
+
+inline bool isCompressedLogPath(const std::string& path) {
+    std::size_t suffix = std::strlen(kCompressedLogSuffix);
+    return path.size() > suffix && path.compare(path.size() - suffix, suffix, kCompressedLogSuffix) == 0;
+}
+
+// The segment a compressed log was made from; its .idx sidecar keeps that name
+inline std::string uncompressedLogPath(const std::string& path) {
+    return isCompressedLogPath(path) ? path.substr(0, path.size() - std::strlen(kCompressedLogSuffix)) : path;
+}
+
+namespace lzblock {
+
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kMaxOffset = 65535;
+constexpr int kHashBits = 13;
+
+inline std::uint32_t read32(const char* p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline std::uint32_t hash(std::uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+inline void putLength(std::string& out, std::size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline void putSequence(std::string& out, const char* literals, std::size_t literalCount, std::size_t offset, std::size_t matchLength) {
+    std::size_t matchCode = matchLength > 0 ? matchLength - kMinMatch : 0;
+    out.push_back(static_cast<char>((std::min<std::size_t>(literalCount, 15) << 4) | std::min<std::size_t>(matchCode, 15)));
+    if (literalCount >= 15) {
+        putLength(out, literalCount - 15);
+    }
+    out.append(literals, literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xff));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (matchCode >= 15) {
+        putLength(out, matchCode - 15);
+    }
+}
+
+// Compress length bytes into out (replacing its contents)
+inline void compress(const char* data, std::size_t length, std::string& out) {
+    out.clear();
+    std::uint32_t table[1 << kHashBits] = {};
+    std::size_t anchor = 0;
+    std::size_t position = 0;
+    while (length >= kMinMatch && position <= length - kMinMatch) {
+        std::uint32_t sequence = read32(data + position);
+        std::uint32_t& slot = table[hash(sequence)];
+        std::size_t candidate = slot; // stored + 1, so 0 means empty
+        slot = static_cast<std::uint32_t>(position + 1);
+        if (candidate == 0 || position - (candidate - 1) > kMaxOffset || read32(data + candidate - 1) != sequence) {
+            ++position;
+            continue;
+        }
+        std::size_t match = candidate - 1;
+        std::size_t matchLength = kMinMatch;
+        while (position + matchLength < length && data[match + matchLength] == data[position + matchLength]) {
+            ++matchLength;
+        }
+        putSequence(out, data + anchor, position - anchor, position - match, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+    putSequence(out, data + anchor, length - anchor, 0, 0);
+}
+
+// Decompress a block that must inflate to exactly rawLength bytes; false if it is damaged
+inline bool decompress(const char* data, std::size_t length, char* out, std::size_t rawLength) {
+    const char* end = data + length;
+    std::size_t written = 0;
+    auto getLength = [&](std::size_t& value) {
+        for (;;) {
+            if (data == end) {
+                return false;
+            }
+            auto byte = static_cast<unsigned char>(*data++);
+            value += byte;
+            if (byte != 255) {
+                return true;
+            }
+        }
+    };
+    while (data < end) {
+        auto token = static_cast<unsigned char>(*data++);
+        std::size_t literalCount = token >> 4;
+        if (literalCount == 15 && !getLength(literalCount)) {
+            return false;
+        }
+        if (literalCount > static_cast<std::size_t>(end - data) || literalCount > rawLength - written) {
+            return false;
+        }
+        std::memcpy(out + written, data, literalCount);
+        data += literalCount;
+        written += literalCount;
+        if (data == end) {
+            break;
+        }
+        if (end - data < 2) {
+            return false;
+        }
+        std::size_t offset = static_cast<unsigned char>(data[0]) | (static_cast<std::size_t>(static_cast<unsigned char>(data[1])) << 8);
+        data += 2;
+        std::size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(matchLength)) {
+            return false;
+        }
+        matchLength += kMinMatch;
+        if (offset == 0 || offset > written || matchLength > rawLength - written) {
+            return false;
+        }
+        // Byte by byte: the match may overlap what it is copying
+        for (std::size_t i = 0; i < matchLength; ++i, ++written) {
+            out[written] = out[written - offset];
+        }
+    }
+    return written == rawLength;
+}
+
+} // namespace lzblock
+
+// Write the compressed form of the log at path to outPath. stop is polled between blocks;
+// returns false if it was set, leaving outPath incomplete for the caller to remove.
+inline bool compressDataLog(const std::string& path, std::uint64_t size, const std::string& outPath, std::uint32_t blockBytes,
+                            const std::atomic<bool>& stop) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        throw std::runtime_error("Could not create " + outPath);
+    }
+
+    CompressedLogHeader header{};
+    std::memcpy(header.magic, kCompressedLogMagic, sizeof(header.magic));
+    header.version = kCompressedLogVersion;
+    header.blockBytes = blockBytes;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<CompressedLogBlock> blocks;
+    std::vector<char> raw(blockBytes);
+    std::string packed;
+    std::uint64_t offset = sizeof(header);
+    for (std::uint64_t rawOffset = 0; rawOffset < size; rawOffset += blockBytes) {
+        if (stop.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        auto rawLength = static_cast<std::uint32_t>(std::min<std::uint64_t>(blockBytes, size - rawOffset));
+        if (!in.read(raw.data(), rawLength)) {
+            throw std::runtime_error("Short read compressing " + path);
+        }
+        lzblock::compress(raw.data(), rawLength, packed);
+        bool stored = packed.size() >= rawLength;
+        auto length = static_cast<std::uint32_t>(stored ? rawLength : packed.size());
+        out.write(stored ? raw.data() : packed.data(), length);
+        blocks.push_back({rawOffset, offset, rawLength, length});
+        offset += length;
+    }
+
+    CompressedLogFooter footer{};
+    footer.indexOffset = offset;
+    footer.blocks = blocks.size();
+    footer.rawSize = size;
+    std::memcpy(footer.magic, kCompressedLogEndMagic, sizeof(footer.magic));
+    out.write(reinterpret_cast<const char*>(blocks.data()), static_cast<std::streamsize>(blocks.size() * sizeof(CompressedLogBlock)));
+    out.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Could not write " + outPath);
+    }
+    return true;
+}
+
+// Reads a compressed log as the original bytes, with seeking, so it can back a std::istream
+// in place of a std::ifstream on the uncompressed segment
+class CompressedLogReader : public std::streambuf {
+public:
+    explicit CompressedLogReader(const std::string& path) : file_(path, std::ios::binary) {
+        if (!file_.is_open()) {
+            throw std::runtime_error("Could not open " + path);
+        }
+        CompressedLogHeader header{};
+        CompressedLogFooter footer{};
+        file_.read(reinterpret_cast<char*>(&header), sizeof(header));
+        file_.seekg(-static_cast<std::streamoff>(sizeof(footer)), std::ios::end);
+        file_.read(reinterpret_cast<char*>(&footer), sizeof(footer));
+        if (!file_ || std::memcmp(header.magic, kCompressedLogMagic, sizeof(header.magic)) != 0 ||
+            header.version != kCompressedLogVersion || std::memcmp(footer.magic, kCompressedLogEndMagic, sizeof(footer.magic)) != 0) {
+            throw std::runtime_error("Not a compressed data log: " + path);
+        }
+        blocks_.resize(footer.blocks);
+        file_.seekg(static_cast<std::streamoff>(footer.indexOffset));
+        file_.read(reinterpret_cast<char*>(blocks_.data()), static_cast<std::streamsize>(blocks_.size() * sizeof(CompressedLogBlock)));
+        if (!file_) {
+            throw std::runtime_error("Damaged block index in " + path);
+        }
+        rawSize_ = footer.rawSize;
+        path_ = path;
+        current_ = blocks_.size(); // nothing buffered yet
+    }
+
+    // Size of the original log
+    std::uint64_t rawSize() const { return rawSize_; }
+
+    // Compressed bytes read so far
+    std::uint64_t bytesRead() const { return bytesRead_; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        if (!load(end_)) {
+            return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override {
+        std::int64_t base = direction == std::ios_base::beg ? 0
+                          : direction == std::ios_base::end ? static_cast<std::int64_t>(rawSize_)
+                          : static_cast<std::int64_t>(position());
+        return seekpos(pos_type(off_type(base + offset)), std::ios_base::in);
+    }
+
+    pos_type seekpos(pos_type target, std::ios_base::openmode) override {
+        auto position = static_cast<std::int64_t>(off_type(target));
+        if (position < 0 || static_cast<std::uint64_t>(position) > rawSize_) {
+            return pos_type(off_type(-1));
+        }
+        auto raw = static_cast<std::uint64_t>(position);
+        if (current_ < blocks_.size() && raw >= blocks_[current_].rawOffset && raw < blocks_[current_].rawOffset + blocks_[current_].rawLength) {
+            setg(buffer_.data(), buffer_.data() + (raw - blocks_[current_].rawOffset), egptr());
+        } else if (!load(raw)) {
+            // At the end: leave an empty window positioned there
+            current_ = blocks_.size();
+            end_ = rawSize_;
+            setg(buffer_.data(), buffer_.data(), buffer_.data());
+        }
+        return target;
+    }
+
+private:
+    std::ifstream file_;
+    std::string path_;
+    std::vector<CompressedLogBlock> blocks_;
+    std::uint64_t rawSize_ = 0;
+    std::size_t current_ = 0;      // block in buffer_, or blocks_.size() for none
+    std::uint64_t end_ = 0;        // original offset just past the buffered window
+    std::vector<char> buffer_;
+    std::string packed_;
+    std::uint64_t bytesRead_ = 0;
+
+    std::uint64_t position() const {
+        return end_ - static_cast<std::uint64_t>(egptr() - gptr());
+    }
+
+    // Inflate the block holding original offset raw and position the get area there
+    bool load(std::uint64_t raw) {
+        auto found = std::upper_bound(blocks_.begin(), blocks_.end(), raw,
+                                      [](std::uint64_t value, const CompressedLogBlock& block) { return value < block.rawOffset; });
+        if (found == blocks_.begin() || raw >= rawSize_) {
+            return false;
+        }
+        const CompressedLogBlock& block = *--found;
+        if (raw >= block.rawOffset + block.rawLength) {
+            return false;
+        }
+        buffer_.resize(block.rawLength);
+        packed_.resize(block.length);
+        file_.clear();
+        file_.seekg(static_cast<std::streamoff>(block.offset));
+        if (!file_.read(packed_.data(), block.length)) {
+            throw std::runtime_error("Truncated compressed data log: " + path_);
+        }
+        bytesRead_ += block.length;
+        if (block.length == block.rawLength) {
+            std::memcpy(buffer_.data(), packed_.data(), block.length);
+        } else if (!lzblock::decompress(packed_.data(), packed_.size(), buffer_.data(), block.rawLength)) {
+            throw std::runtime_error("Corrupt block in compressed data log: " + path_);
+        }
+        current_ = static_cast<std::size_t>(found - blocks_.begin());
+        end_ = block.rawOffset + block.rawLength;
+        setg(buffer_.data(), buffer_.data() + (raw - block.rawOffset), buffer_.data() + block.rawLength);
+        return true;
+    }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Sparse time index kept next to each DataRecorder log segment, in <segment>.idx.
+//
+// Layout (native little-endian):
+//   DataLogIndexHeader
+//   DataLogIndexEntry[]   appended as the writer passes each block boundary
+//
+// The log is cut into blocks of roughly blockBytes, always on record boundaries. Each entry
+// describes one block: where it is, and the earliest and latest record time inside it. Records
+// from concurrent producers are only roughly time-ordered, so a query checks every block's
+// range rather than binary searching on a single timestamp. Ranges of the log that no entry
+// covers (the block still being written, or data recorded before the index existed) are
+// scanned in full.
+
+struct DataLogIndexHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t blockBytes;
+};
+
+struct DataLogIndexEntry {
+    std::uint64_t offset;
+    std::uint64_t length;
+    std::int64_t minNanos; // realtime nanoseconds since the epoch
+    std::int64_t maxNanos;
+    std::uint32_t records;
+    std::uint32_t flags;
+};
+
+static_assert(sizeof(DataLogIndexHeader) == 16, "DataLogIndexHeader layout is part of the file format");
+static_assert(sizeof(DataLogIndexEntry) == 40, "DataLogIndexEntry layout is part of the file format");
+
+constexpr char kDataLogIndexMagic[8] = {'V', 'E', 'L', 'O', 'G', 'I', 'D', 'X'};
+constexpr std::uint32_t kDataLogIndexVersion = 1;
+
+// The block holds SESSION or FORMAT records a binary decoder needs before any later block
+constexpr std::uint32_t kDataLogIndexDefinitions = 1;
+
+inline std::string dataLogIndexPath(const std::string& logPath) {
+    return logPath + ".idx";
+}
+
+// Entries of a sidecar index, in log order. A missing index yields none; a torn final entry
+// from an interrupted writer is ignored.
+inline std::vector<DataLogIndexEntry> loadDataLogIndex(const std::string& logPath) {
+    std::vector<DataLogIndexEntry> entries;
+    std::ifstream in(dataLogIndexPath(logPath), std::ios::binary);
+    if (!in.is_open()) {
+        return entries;
+    }
+    DataLogIndexHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return entries;
+    }
+    if (std::memcmp(header.magic, kDataLogIndexMagic, sizeof(header.magic)) != 0 || header.version != kDataLogIndexVersion) {
+        throw std::runtime_error("Not a data log index: " + dataLogIndexPath(logPath));
+    }
+    DataLogIndexEntry entry{};
+    while (in.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+        entries.push_back(entry);
+    }
+    return entries;
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include "TimestampCache.h"
+
+// Binary DataRecorder format.
+//
+// A binary log is a sequence of length-prefixed records (native little-endian):
+//   u32 length   bytes that follow, kind included
+//   u8  kind     BinaryRecordKind
+//   ...          kind-specific body
+//
+// SESSION  char magic[8], i64 realtime ns, i64 monotonic ns
+//          Starts every recorder session; anchors monotonic timestamps to wall time and
+//          resets the format table, so appended sessions decode independently.
+// FORMAT   u16 format id, format string bytes
+//          Interns a format string; emitted once per session before its first use.
+// EVENT    i64 monotonic ns, u32 thread id, u16 event type, u16 format id, u8 arg count, args
+//          Each arg is a u8 BinaryArgTag followed by its value. Integers are LEB128 varints
+//          (zigzag for signed), doubles are 8 raw bytes, strings are a varint length + bytes.
+//
+// Format strings use "{}" placeholders, substituted with the args in order when decoding.
+
+enum class BinaryRecordKind : std::uint8_t {
+    SESSION = 1,
+    FORMAT = 2,
+    EVENT = 3
+};
+
+enum class BinaryArgTag : std::uint8_t {
+    INT64 = 1,
+    UINT64 = 2,
+    DOUBLE = 3,
+    BOOL = 4,
+    STRING = 5
+};
+
+constexpr char kBinaryLogMagic[8] = {'V', 'E', 'B', 'I', 'N', 'L', 'G', '1'};
+constexpr std::size_t kBinaryRecordMaxLength = 16 * 1024 * 1024;
+
+// Monotonic nanoseconds, the timestamp carried by EVENT records
+inline std::int64_t monotonicNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Small sequential id for the calling thread; cheaper to store than std::thread::id
+inline std::uint32_t recordThreadId() {
+    static std::atomic<std::uint32_t> next{1};
+    thread_local std::uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+// Format id of an encoded EVENT record (length prefix included), or -1 for other kinds
+inline int eventFormatId(const char* record, std::size_t length) {
+    constexpr std::size_t kindOffset = sizeof(std::uint32_t);
+    constexpr std::size_t formatOffset = kindOffset + 1 + sizeof(std::int64_t) + sizeof(std::uint32_t) + sizeof(std::uint16_t);
+    if (length < formatOffset + sizeof(std::uint16_t) || static_cast<BinaryRecordKind>(record[kindOffset]) != BinaryRecordKind::EVENT) {
+        return -1;
+    }
+    std::uint16_t formatId;
+    std::memcpy(&formatId, record + formatOffset, sizeof(formatId));
+    return formatId;
+}
+
+// Monotonic timestamp of an encoded EVENT record (length prefix included), or -1 for other kinds
+inline std::int64_t eventMonotonicNanos(const char* record, std::size_t length) {
+    constexpr std::size_t kindOffset = sizeof(std::uint32_t);
+    constexpr std::size_t timeOffset = kindOffset + 1;
+    if (length < timeOffset + sizeof(std::int64_t) || static_cast<BinaryRecordKind>(record[kindOffset]) != BinaryRecordKind::EVENT) {
+        return -1;
+    }
+    std::int64_t nanos;
+    std::memcpy(&nanos, record + timeOffset, sizeof(nanos));
+    return nanos;
+}
+
+// Builds one binary record. Small records stay in an inline buffer; larger ones move to the heap.
+// Anything the decoder would reject, i.e. more than kMaxArgs args or a record longer than
+// kBinaryRecordMaxLength, throws std::runtime_error here instead.
+class BinaryRecordEncoder {
+public:
+    static constexpr std::size_t kMaxArgs = 255; // the count is stored in one byte
+
+    void beginSession(std::int64_t realtimeNanos, std::int64_t monotonicNanos) {
+        begin(BinaryRecordKind::SESSION);
+        append(kBinaryLogMagic, sizeof(kBinaryLogMagic));
+        put(realtimeNanos);
+        put(monotonicNanos);
+    }
+
+    void beginFormat(std::uint16_t formatId, std::string_view format) {
+        begin(BinaryRecordKind::FORMAT);
+        put(formatId);
+        append(format.data(), format.size());
+    }
+
+    void beginEvent(std::int64_t monotonicNanos, std::uint32_t threadId, std::uint16_t eventType, std::uint16_t formatId) {
+        begin(BinaryRecordKind::EVENT);
+        put(monotonicNanos);
+        put(threadId);
+        put(eventType);
+        put(formatId);
+        argCountOffset_ = size_;
+        put(std::uint8_t{0});
+    }
+
+    template<typename T>
+    void addArg(const T& value) {
+        if (static_cast<std::uint8_t>(data()[argCountOffset_]) == kMaxArgs) {
+            throw std::runtime_error("Binary record has more than " + std::to_string(kMaxArgs) + " args");
+        }
+        if constexpr (std::is_same_v<T, bool>) {
+            put(BinaryArgTag::BOOL);
+            put(static_cast<std::uint8_t>(value));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            auto wide = static_cast<std::int64_t>(value);
+            put(BinaryArgTag::INT64);
+            putVarint((static_cast<std::uint64_t>(wide) << 1) ^ static_cast<std::uint64_t>(wide >> 63));
+        } else if constexpr (std::is_integral_v<T>) {
+            put(BinaryArgTag::UINT64);
+            putVarint(static_cast<std::uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            put(BinaryArgTag::DOUBLE);
+            put(static_cast<double>(value));
+        } else {
+            std::string_view text(value);
+            put(BinaryArgTag::STRING);
+            putVarint(text.size());
+            append(text.data(), text.size());
+        }
+        ++data()[argCountOffset_];
+    }
+
+    // The finished record, length prefix included; valid until the next begin call
+    std::string_view finish() {
+        if (size_ - sizeof(std::uint32_t) > kBinaryRecordMaxLength) {
+            throw std::runtime_error("Binary record of " + std::to_string(size_ - sizeof(std::uint32_t)) + " bytes is over the limit");
+        }
+        std::uint32_t length = static_cast<std::uint32_t>(size_ - sizeof(std::uint32_t));
+        std::memcpy(data(), &length, sizeof(length));
+        return std::string_view(data(), size_);
+    }
+
+private:
+    static constexpr std::size_t kInlineCapacity = 512;
+
+    char inline_[kInlineCapacity];
+    std::string heap_;
+    bool onHeap_ = false;
+    std::size_t size_ = 0;
+    std::size_t argCountOffset_ = 0;
+
+    char* data() { return onHeap_ ? heap_.data() : inline_; }
+
+    void begin(BinaryRecordKind kind) {
+        onHeap_ = false;
+        size_ = sizeof(std::uint32_t);
+        put(kind);
+    }
+
+    template<typename T>
+    void put(const T& value) {
+        append(&value, sizeof(value));
+    }
+
+    void putVarint(std::uint64_t value) {
+        char bytes[10];
+        std::size_t count = 0;
+        while (value >= 0x80) {
+            bytes[count++] = static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        bytes[count++] = static_cast<char>(value);
+        append(bytes, count);
+    }
+
+    void append(const void* bytes, std::size_t count) {
+        if (!onHeap_ && size_ + count > kInlineCapacity) {
+            heap_.assign(inline_, size_);
+            onHeap_ = true;
+        }
+        if (onHeap_) {
+            heap_.resize(size_ + count);
+        }
+        std::memcpy(data() + size_, bytes, count);
+        size_ += count;
+    }
+};
+
+// A decoded EVENT record
+struct BinaryEvent {
+    std::int64_t monotonicNanos = 0;
+    std::int64_t realtimeNanos = 0;
+    std::uint32_t threadId = 0;
+    std::uint16_t eventType = 0;
+    std::string message;
+};
+
+// Reads binary records back, tracking session anchors and interned formats
+class BinaryRecordDecoder {
+public:
+    // Read the next record body (length prefix stripped). False at a clean end of input.
+    static bool readRecord(std::istream& in, std::string& body) {
+        std::uint32_t length = 0;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            if (in.gcount() == 0) {
+                return false;
+            }
+            throw std::runtime_error("Truncated record length");
+        }
+        if (length == 0 || length > kBinaryRecordMaxLength) {
+            throw std::runtime_error("Corrupt record length " + std::to_string(length));
+        }
+        body.resize(length);
+        if (!in.read(body.data(), length)) {
+            throw std::runtime_error("Truncated record body");
+        }
+        return true;
+    }
+
+    // Apply one record body. Returns true and fills event for EVENT records.
+    bool decode(std::string_view body, BinaryEvent& event) {
+        Cursor cursor{body};
+        auto kind = cursor.get<BinaryRecordKind>();
+        switch (kind) {
+            case BinaryRecordKind::SESSION: {
+                std::string_view magic = cursor.bytes(sizeof(kBinaryLogMagic));
+                if (magic != std::string_view(kBinaryLogMagic, sizeof(kBinaryLogMagic))) {
+                    throw std::runtime_error("Bad session magic");
+                }
+                realtimeAnchor_ = cursor.get<std::int64_t>();
+                monotonicAnchor_ = cursor.get<std::int64_t>();
+                formats_.clear();
+                return false;
+            }
+            case BinaryRecordKind::FORMAT: {
+                auto id = cursor.get<std::uint16_t>();
+                formats_[id] = std::string(cursor.rest());
+                return false;
+            }
+            case BinaryRecordKind::EVENT: {
+                event.monotonicNanos = cursor.get<std::int64_t>();
+                event.realtimeNanos = realtimeAnchor_ + (event.monotonicNanos - monotonicAnchor_);
+                event.threadId = cursor.get<std::uint32_t>();
+                event.eventType = cursor.get<std::uint16_t>();
+                auto formatId = cursor.get<std::uint16_t>();
+                auto argCount = cursor.get<std::uint8_t>();
+                auto format = formats_.find(formatId);
+                if (format == formats_.end()) {
+                    throw std::runtime_error("Event uses undefined format " + std::to_string(formatId));
+                }
+                renderMessage(format->second, argCount, cursor, event.message);
+                return true;
+            }
+        }
+        throw std::runtime_error("Unknown record kind " + std::to_string(static_cast<int>(kind)));
+    }
+
+    // Render an event as "timestamp [tid] [type] message"
+    static void formatEvent(const BinaryEvent& event, std::string& out) {
+        std::chrono::system_clock::time_point timePoint{
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(event.realtimeNanos))};
+        out.append(TimestampCache::view(timePoint, TimestampPrecision::MICROSECONDS));
+        out.append(" [").append(std::to_string(event.threadId));
+        out.append("] [").append(std::to_string(event.eventType));
+        out.append("] ").append(event.message);
+    }
+
+private:
+    struct Cursor {
+        std::string_view data;
+
+        template<typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, bytes(sizeof(T)).data(), sizeof(T));
+            return value;
+        }
+
+        std::string_view bytes(std::size_t count) {
+            if (count > data.size()) {
+                throw std::runtime_error("Record body too short");
+            }
+            std::string_view result = data.substr(0, count);
+            data.remove_prefix(count);
+            return result;
+        }
+
+        std::string_view rest() {
+            return bytes(data.size());
+        }
+
+        std::uint64_t varint() {
+            std::uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                auto byte = get<std::uint8_t>();
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+            throw std::runtime_error("Varint too long");
+        }
+    };
+
+    std::int64_t realtimeAnchor_ = 0;
+    std::int64_t monotonicAnchor_ = 0;
+    std::unordered_map<std::uint16_t, std::string> formats_;
+
+    static void renderMessage(std::string_view format, std::uint8_t argCount, Cursor& cursor, std::string& out) {
+        out.clear();
+        std::uint8_t used = 0;
+        for (std::size_t i = 0; i < format.size(); ++i) {
+            if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && used < argCount) {
+                renderArg(cursor, out);
+                ++used;
+                ++i;
+            } else {
+                out.push_back(format[i]);
+            }
+        }
+        // Args without a placeholder are appended so nothing recorded is lost
+        for (; used < argCount; ++used) {
+            out.push_back(' ');
+            renderArg(cursor, out);
+        }
+    }
+
+    static void renderArg(Cursor& cursor, std::string& out) {
+        switch (cursor.get<BinaryArgTag>()) {
+            case BinaryArgTag::INT64: {
+                std::uint64_t zigzag = cursor.varint();
+                out.append(std::to_string(static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1)));
+                return;
+            }
+            case BinaryArgTag::UINT64: out.append(std::to_string(cursor.varint())); return;
+            case BinaryArgTag::DOUBLE: out.append(std::to_string(cursor.get<double>())); return;
+            case BinaryArgTag::BOOL: out.append(cursor.get<std::uint8_t>() ? "true" : "false"); return;
+            case BinaryArgTag::STRING: {
+                auto length = cursor.varint();
+                out.append(cursor.bytes(static_cast<std::size_t>(length)));
+                return;
+            }
+        }
+        throw std::runtime_error("Unknown argument tag");
+    }
+};
@@ -0,0 +1,1208 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "MpscRing.h"
+#include "TimestampCache.h"
+#include "DataRecordFormat.h"
+#include "DataLogIndex.h"
+#include "DataLogCompression.h"
+#include "DataSinks.h"
+
+// How records are laid out in the output file
+enum class RecordFormat {
+    TEXT,  // "timestamp - data" lines
+    BINARY // length-prefixed binary records, decoded offline by ve-logcat (see DataRecordFormat.h)
+};
+
+// What an async DataRecorder does when its ring buffer is full
+enum class OverflowPolicy {
+    BLOCK, // wait for the writer to make room
+    DROP,  // discard the record and count it
+    SPILL  // queue the record on an unbounded, mutex-protected overflow list
+};
+
+// Where async producers leave records for the writer thread
+enum class AsyncBuffering {
+    SHARED_RING, // one lock-free ring for all producers; records are written in the order they were queued
+    PER_THREAD   // a preallocated ring per producer thread, merged into timestamp order by the writer
+};
+
+// Settings for DataRecorder's async mode
+struct AsyncOptions {
+    std::size_t capacity = 8192;      // ring slots (per producer thread with PER_THREAD), rounded up to a power of two;
+                                      // a record takes one per 236 bytes
+    AsyncBuffering buffering = AsyncBuffering::SHARED_RING;
+    std::size_t batchBytes = 64 * 1024; // writer flushes once a batch reaches this size
+    OverflowPolicy overflow = OverflowPolicy::BLOCK;
+    bool echo = false;                // also echo records to stdout, through a ConsoleSink
+    TimestampPrecision precision = TimestampPrecision::SECONDS;
+    RecordFormat format = RecordFormat::TEXT;
+};
+
+// Rotation, preallocation and durability settings for DataRecorder's output file
+struct SegmentOptions {
+    std::uint64_t maxBytes = 0;                // start a new segment before one would exceed this; 0 never
+    std::chrono::seconds maxAge{0};            // start a new segment once one is this old; 0 never
+    std::uint64_t preallocateBytes = 0;        // disk space reserved when a segment is opened
+    std::chrono::milliseconds syncInterval{0}; // group commit: fdatasync pending bytes this often
+    std::uint64_t syncBytes = 0;               // group commit: fdatasync once this many bytes are pending
+    std::uint32_t indexBytes = 4096;           // sidecar time index granularity (see DataLogIndex.h); 0 disables
+    bool compressClosed = false;               // compress segments into <segment>.lz once closed (see DataLogCompression.h)
+    std::uint32_t compressBlockBytes = 64 * 1024;
+
+    bool segmented() const { return maxBytes > 0 || maxAge.count() > 0; }
+    bool groupCommit() const { return syncInterval.count() > 0 || syncBytes > 0; }
+};
+
+// Append-only output file for DataRecorder. With rotation configured it writes numbered
+// segments (<base>.000001, <base>.000002, ...), continuing after any that already exist;
+// otherwise it appends to <base> itself. Each file gets a sparse time index in <file>.idx.
+//
+// Writes come from one thread at a time: the recorder's writer thread, or callers holding
+// the recorder's mutex. Durability is a group commit: a background thread fdatasyncs what is
+// pending every syncInterval or syncBytes, and every caller waiting on a range that sync
+// covered is released together. Without group commit settings, waitDurable syncs directly.
+//
+// With compressClosed, a low-priority background thread replaces each closed segment with its
+// compressed form, picking up any left uncompressed by an earlier run as well.
+class LogFile {
+public:
+    LogFile(const std::string& base, const SegmentOptions& options) : base_(base), options_(options) {
+        if (options_.segmented()) {
+            nextSegment_ = lastSegmentNumber(base_) + 1;
+        }
+        if (options_.segmented() && options_.compressClosed) {
+            for (std::uint64_t number = 1; number < nextSegment_; ++number) {
+                std::string path = segmentPath(base_, number);
+                std::error_code error;
+                std::uint64_t size = std::filesystem::file_size(path, error);
+                if (!error) {
+                    compressQueue_.push_back({path, size});
+                }
+            }
+            compressThread_ = std::thread(&LogFile::compressLoop, this);
+        }
+        segment_ = openSegment();
+        if (options_.groupCommit()) {
+            syncThread_ = std::thread(&LogFile::syncLoop, this);
+        }
+    }
+
+    ~LogFile() {
+        closeBlock(*segment_, segment_->size);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        syncCv_.notify_all();
+        durableCv_.notify_all();
+        if (syncThread_.joinable()) {
+            syncThread_.join();
+        }
+        // Segments still waiting are compressed by the next LogFile on this base
+        if (compressThread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(compressMutex_);
+                compressStop_.store(true);
+            }
+            compressCv_.notify_one();
+            compressThread_.join();
+        }
+    }
+
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    // Whether the next incoming bytes belong in a fresh segment. Writer only.
+    bool shouldRotate(std::size_t incoming) const {
+        if (!options_.segmented() || segment_->size == 0) {
+            return false;
+        }
+        if (options_.maxBytes > 0 && segment_->size + incoming > options_.maxBytes) {
+            return true;
+        }
+        return options_.maxAge.count() > 0 && std::chrono::steady_clock::now() - segment_->opened >= options_.maxAge;
+    }
+
+    // Close the current segment, synced and with its preallocation trimmed, and open the next one. Writer only.
+    void rotate() {
+        closeBlock(*segment_, segment_->size);
+        syncFile(segment_->fd);
+        std::shared_ptr<Segment> next = openSegment();
+        CompressJob closed{segment_->path, segment_->size};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            durable_ = written_;
+            segment_ = std::move(next);
+        }
+        durableCv_.notify_all();
+        if (compressThread_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(compressMutex_);
+                compressQueue_.push_back(std::move(closed));
+            }
+            compressCv_.notify_one();
+        }
+    }
+
+    // Append bytes to the current segment. Writer only.
+    void write(std::string_view bytes) {
+        if (bytes.empty()) {
+            return;
+        }
+        Segment& segment = *segment_;
+        const char* data = bytes.data();
+        std::size_t remaining = bytes.size();
+        while (remaining > 0) {
+            ssize_t count = ::write(segment.fd, data, remaining);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "DataRecorder write to " << segment.path << " failed: " << std::strerror(errno) << std::endl;
+                return;
+            }
+            data += count;
+            remaining -= static_cast<std::size_t>(count);
+        }
+        segment.size += bytes.size();
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            bool firstPending = written_ == durable_;
+            if (firstPending) {
+                firstPending_ = std::chrono::steady_clock::now();
+            }
+            written_ += bytes.size();
+            wake = (firstPending && options_.syncInterval.count() > 0) ||
+                   (options_.syncBytes > 0 && written_ - durable_ >= options_.syncBytes);
+        }
+        if (wake && syncThread_.joinable()) {
+            syncCv_.notify_one();
+        }
+    }
+
+    // Note a record about to be staged pending bytes after what has been written to the current
+    // segment, for the time index. Writer only.
+    void index(std::uint64_t pending, std::int64_t nanos, bool definitions) {
+        if (options_.indexBytes == 0) {
+            return;
+        }
+        Segment& segment = *segment_;
+        std::uint64_t offset = segment.size + pending;
+        if (segment.block.records > 0 && offset - segment.block.offset >= options_.indexBytes) {
+            closeBlock(segment, offset);
+        }
+        DataLogIndexEntry& block = segment.block;
+        if (block.records == 0) {
+            block.minNanos = nanos;
+            block.maxNanos = nanos;
+        } else {
+            block.minNanos = std::min(block.minNanos, nanos);
+            block.maxNanos = std::max(block.maxNanos, nanos);
+        }
+        ++block.records;
+        if (definitions) {
+            block.flags |= kDataLogIndexDefinitions;
+        }
+    }
+
+    // Bytes written so far across all segments; the offsets waitDurable takes
+    std::uint64_t written() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return written_;
+    }
+
+    // Block until the first offset bytes are on disk
+    void waitDurable(std::uint64_t offset) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (durable_ >= offset) {
+            return;
+        }
+        if (!syncThread_.joinable()) {
+            syncLocked(lock);
+            return;
+        }
+        ++waiters_;
+        syncCv_.notify_one();
+        durableCv_.wait(lock, [&]() { return durable_ >= offset || stopping_; });
+        --waiters_;
+    }
+
+    // Number of fdatasync calls made for waiters and group commits, rotations excluded
+    std::uint64_t syncCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return syncs_;
+    }
+
+    // Number of closed segments replaced by their compressed form
+    std::uint64_t compressedCount() const {
+        std::lock_guard<std::mutex> lock(compressMutex_);
+        return compressed_;
+    }
+
+private:
+    struct Segment {
+        int fd = -1;
+        int indexFd = -1;
+        std::string path;
+        std::uint64_t size = 0;
+        bool preallocated = false;
+        std::chrono::steady_clock::time_point opened = std::chrono::steady_clock::now();
+        DataLogIndexEntry block{}; // the index block being filled; writer only
+
+        ~Segment() {
+            if (indexFd >= 0) {
+                ::close(indexFd);
+            }
+            if (fd < 0) {
+                return;
+            }
+            // Give back the reserved space past what was actually written
+            if (preallocated && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                std::cerr << "Could not trim " << path << ": " << std::strerror(errno) << std::endl;
+            }
+            ::close(fd);
+        }
+    };
+
+    std::string base_;
+    SegmentOptions options_;
+    std::uint64_t nextSegment_ = 1;
+    std::shared_ptr<Segment> segment_; // swapped under mutex_ by the writer; the sync thread copies it under mutex_
+
+    mutable std::mutex mutex_;
+    std::condition_variable syncCv_;
+    std::condition_variable durableCv_;
+    std::uint64_t written_ = 0;
+    std::uint64_t durable_ = 0;
+    std::uint64_t syncs_ = 0;
+    std::size_t waiters_ = 0;
+    std::chrono::steady_clock::time_point firstPending_;
+    bool stopping_ = false;
+    std::thread syncThread_;
+
+    struct CompressJob {
+        std::string path;
+        std::uint64_t size;
+    };
+
+    mutable std::mutex compressMutex_;
+    std::condition_variable compressCv_;
+    std::deque<CompressJob> compressQueue_;
+    std::atomic<bool> compressStop_{false};
+    std::uint64_t compressed_ = 0;
+    std::thread compressThread_;
+
+    static std::string segmentPath(const std::string& base, std::uint64_t number) {
+        std::ostringstream path;
+        path << base << '.' << std::setw(6) << std::setfill('0') << number;
+        return path.str();
+    }
+
+    // Highest existing segment number for base, 0 if there are none
+    static std::uint64_t lastSegmentNumber(const std::string& base) {
+        namespace fs = std::filesystem;
+        fs::path basePath(base);
+        fs::path directory = basePath.has_parent_path() ? basePath.parent_path() : fs::path(".");
+        std::string prefix = basePath.filename().string() + ".";
+        std::uint64_t last = 0;
+        std::error_code error;
+        for (const auto& entry : fs::directory_iterator(directory, error)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() <= prefix.size() || name.size() > prefix.size() + 18 || name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+            // Compressed segments keep their numbers
+            std::string suffix = uncompressedLogPath(name.substr(prefix.size()));
+            if (!suffix.empty() && suffix.find_first_not_of("0123456789") == std::string::npos) {
+                last = std::max<std::uint64_t>(last, std::stoull(suffix));
+            }
+        }
+        return last;
+    }
+
+    std::shared_ptr<Segment> openSegment() {
+        auto segment = std::make_shared<Segment>();
+        segment->path = options_.segmented() ? segmentPath(base_, nextSegment_++) : base_;
+        segment->fd = ::open(segment->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (segment->fd < 0) {
+            throw std::runtime_error("Could not open file for recording data: " + segment->path);
+        }
+        struct stat st {};
+        if (::fstat(segment->fd, &st) == 0) {
+            segment->size = static_cast<std::uint64_t>(st.st_size);
+        }
+#ifdef __linux__
+        if (options_.preallocateBytes > segment->size) {
+            // KEEP_SIZE reserves blocks without moving EOF, so appends still land after the last record
+            segment->preallocated = ::fallocate(segment->fd, FALLOC_FL_KEEP_SIZE, 0,
+                                                static_cast<off_t>(options_.preallocateBytes)) == 0;
+        }
+#endif
+        segment->block.offset = segment->size;
+        if (options_.indexBytes > 0) {
+            openIndex(*segment);
+        }
+        return segment;
+    }
+
+    void openIndex(Segment& segment) {
+        std::string path = dataLogIndexPath(segment.path);
+        segment.indexFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (segment.indexFd < 0) {
+            std::cerr << "Could not open " << path << ", recording without a time index" << std::endl;
+            return;
+        }
+        struct stat st {};
+        ::fstat(segment.indexFd, &st);
+        auto size = static_cast<std::uint64_t>(st.st_size);
+        if (size < sizeof(DataLogIndexHeader)) {
+            DataLogIndexHeader header{};
+            std::memcpy(header.magic, kDataLogIndexMagic, sizeof(header.magic));
+            header.version = kDataLogIndexVersion;
+            header.blockBytes = options_.indexBytes;
+            if (::ftruncate(segment.indexFd, 0) != 0 || ::write(segment.indexFd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+                std::cerr << "Could not write " << path << ": " << std::strerror(errno) << std::endl;
+            }
+        } else if ((size - sizeof(DataLogIndexHeader)) % sizeof(DataLogIndexEntry) != 0) {
+            // Drop an entry torn by a crash so new entries stay aligned
+            std::uint64_t whole = (size - sizeof(DataLogIndexHeader)) / sizeof(DataLogIndexEntry);
+            if (::ftruncate(segment.indexFd, static_cast<off_t>(sizeof(DataLogIndexHeader) + whole * sizeof(DataLogIndexEntry))) != 0) {
+                std::cerr << "Could not repair " << path << ": " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    // Write out the current index block, which ends at end, and start the next one there
+    void closeBlock(Segment& segment, std::uint64_t end) {
+        DataLogIndexEntry& block = segment.block;
+        if (block.records > 0 && segment.indexFd >= 0) {
+            block.length = end - block.offset;
+            if (::write(segment.indexFd, &block, sizeof(block)) != static_cast<ssize_t>(sizeof(block))) {
+                std::cerr << "Could not update the index of " << segment.path << std::endl;
+            }
+        }
+        block = DataLogIndexEntry{};
+        block.offset = end;
+    }
+
+    static void syncFile(int fd) {
+#ifdef __linux__
+        ::fdatasync(fd);
+#else
+        ::fsync(fd);
+#endif
+    }
+
+    // Sync everything written so far; mutex_ is released while the disk works
+    void syncLocked(std::unique_lock<std::mutex>& lock) {
+        std::shared_ptr<Segment> segment = segment_;
+        std::uint64_t target = written_;
+        lock.unlock();
+        syncFile(segment->fd);
+        segment.reset();
+        lock.lock();
+        durable_ = std::max(durable_, target);
+        ++syncs_;
+        durableCv_.notify_all();
+    }
+
+    // Replace closed segments with <segment>.lz, oldest first, at the lowest CPU and I/O priority
+    void compressLoop() {
+#ifdef __linux__
+        // On Linux both apply to this thread alone
+        auto thread = static_cast<id_t>(::syscall(SYS_gettid));
+        ::setpriority(PRIO_PROCESS, thread, 19);
+        constexpr int kIoprioWhoProcess = 1;
+        constexpr int kIoprioClassIdle = 3;
+        ::syscall(SYS_ioprio_set, kIoprioWhoProcess, static_cast<int>(thread), kIoprioClassIdle << 13);
+#endif
+        for (;;) {
+            CompressJob job;
+            {
+                std::unique_lock<std::mutex> lock(compressMutex_);
+                compressCv_.wait(lock, [this]() { return compressStop_.load() || !compressQueue_.empty(); });
+                if (compressStop_.load()) {
+                    return;
+                }
+                job = std::move(compressQueue_.front());
+                compressQueue_.pop_front();
+            }
+            if (compressSegment(job)) {
+                std::lock_guard<std::mutex> lock(compressMutex_);
+                ++compressed_;
+            }
+        }
+    }
+
+    // Write the compressed segment under a temporary name, make it durable, then swap it in
+    bool compressSegment(const CompressJob& job) {
+        std::string target = job.path + kCompressedLogSuffix;
+        std::string temporary = target + ".tmp";
+        try {
+            if (!compressDataLog(job.path, job.size, temporary, options_.compressBlockBytes, compressStop_)) {
+                std::filesystem::remove(temporary);
+                return false;
+            }
+            int fd = ::open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+            bool synced = fd >= 0 && ::fsync(fd) == 0;
+            int error = errno;
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            if (!synced) {
+                throw std::runtime_error(std::strerror(error));
+            }
+            std::filesystem::rename(temporary, target);
+            syncDirectory(target);
+            std::filesystem::remove(job.path);
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Could not compress " << job.path << ": " << e.what() << std::endl;
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+
+    static void syncDirectory(const std::string& path) {
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        int fd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    void syncLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            std::uint64_t pending = written_ - durable_;
+            bool bytesDue = options_.syncBytes > 0 && pending >= options_.syncBytes;
+            // Without an interval nothing would batch waiters, so they are synced as soon as they ask
+            bool waitersDue = waiters_ > 0 && options_.syncInterval.count() == 0;
+            if (pending > 0 && (bytesDue || waitersDue)) {
+                syncLocked(lock);
+            } else if (pending > 0 && options_.syncInterval.count() > 0) {
+                auto due = firstPending_ + options_.syncInterval;
+                if (std::chrono::steady_clock::now() >= due) {
+                    syncLocked(lock);
+                } else {
+                    syncCv_.wait_until(lock, due);
+                }
+            } else {
+                syncCv_.wait(lock);
+            }
+        }
+        if (written_ > durable_) {
+            syncLocked(lock);
+        }
+    }
+};
+
+// A class to manage data recording
+class DataRecorder {
+public:
+    // Counters for an async recorder, apart from syncs, sinkDropped and compressed which every mode counts
+    struct Stats {
+        std::uint64_t recorded = 0;
+        std::uint64_t dropped = 0;
+        std::uint64_t spilled = 0;
+        std::uint64_t syncs = 0;       // fdatasync calls made for waitDurable and group commit
+        std::uint64_t sinkDropped = 0; // records sinks missed because their queues were full
+        std::uint64_t compressed = 0;  // closed segments compressed in the background
+    };
+
+    // Text mode echoes every record to stdout through a ConsoleSink
+    DataRecorder(const std::string& filename, RecordFormat format = RecordFormat::TEXT,
+                 const SegmentOptions& segments = SegmentOptions())
+        : filename_(filename), format_(format),
+          logFile_(std::make_unique<LogFile>(filename, segments)) {
+        startSegment(syncBatch_);
+        flush(syncBatch_);
+        if (format_ == RecordFormat::TEXT) {
+            addSink(std::make_shared<ConsoleSink>());
+        }
+    }
+
+    // Async mode: producers push fixed-size records into a lock-free ring and a single
+    // writer thread formats them and writes them to the file in large batches. With
+    // AsyncBuffering::PER_THREAD each producer thread gets a preallocated ring of its own on
+    // first use, and the writer merges them so the file is in timestamp order.
+    DataRecorder(const std::string& filename, const AsyncOptions& options,
+                 const SegmentOptions& segments = SegmentOptions())
+        : filename_(filename), format_(options.format), async_(true), options_(options),
+          logFile_(std::make_unique<LogFile>(filename, segments)) {
+        if (options.buffering == AsyncBuffering::SHARED_RING) {
+            ring_ = std::make_unique<MpscRing<AsyncRecord>>(options.capacity);
+        }
+        startSegment(syncBatch_);
+        flush(syncBatch_);
+        if (options.echo) {
+            addSink(std::make_shared<ConsoleSink>());
+        }
+        writer_ = std::thread(&DataRecorder::writerLoop, this);
+    }
+
+    ~DataRecorder() {
+        if (writer_.joinable()) {
+            stopping_.store(true);
+            wakeWriter(true);
+            writer_.join();
+        }
+        // Producer threads may outlive the recorder; let them drop their buffers
+        for (auto& buffer : threadBuffers_) {
+            buffer->detached.store(true);
+        }
+    }
+
+    // Fan records out to sink as well as the log file. The sink gets its own queue and thread;
+    // options filter by level and sample. Add sinks before recording from other threads.
+    void addSink(std::shared_ptr<DataSink> sink, const SinkOptions& options = SinkOptions()) {
+        sinks_.push_back(std::make_unique<SinkChannel>(std::move(sink), options));
+    }
+
+    void recordData(const std::string& data) {
+        recordData(RecordLevel::INFO, data);
+    }
+
+    // The level only matters to sinks; the log file keeps every record
+    void recordData(RecordLevel level, const std::string& data) {
+        if (format_ == RecordFormat::BINARY) {
+            publish(std::chrono::system_clock::now().time_since_epoch().count(), level, data);
+            recordBinary(0, "{}", data);
+            return;
+        }
+        PendingRecord pending(*this);
+        std::int64_t time = std::chrono::system_clock::now().time_since_epoch().count();
+        publish(time, level, data);
+        if (async_) {
+            recordAsync(pending.order(), time, data);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            appendRecord(syncBatch_, time, data.data(), data.size());
+            flush(syncBatch_);
+        }
+    }
+
+    // Record a structured event. format is a string literal with "{}" placeholders for args.
+    // In binary mode only the event type, an interned format id and the raw args are written,
+    // so nothing is formatted on the calling thread unless a sink wants the record; in text
+    // mode the message is rendered here.
+    template<typename... Args>
+    void recordEvent(std::uint16_t eventType, const char* format, const Args&... args) {
+        if (format_ == RecordFormat::TEXT) {
+            recordData(renderText(format, args...));
+            return;
+        }
+        if (sinksAccept(RecordLevel::INFO)) {
+            publish(std::chrono::system_clock::now().time_since_epoch().count(), RecordLevel::INFO, renderText(format, args...));
+        }
+        recordBinary(eventType, format, args...);
+    }
+
+    // Block until everything recorded before this call is on disk. With group commit
+    // configured, callers arriving within the same sync window share one fdatasync.
+    void waitDurable() {
+        std::uint64_t offset;
+        if (!async_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            offset = logFile_->written();
+        } else {
+            // Have the writer drain everything published so far and report where the log ends
+            std::uint64_t request = drainRequests_.fetch_add(1) + 1;
+            wakeWriter(true);
+            std::unique_lock<std::mutex> lock(drainMutex_);
+            drainCv_.wait(lock, [&]() { return drained_ >= request; });
+            offset = drainedOffset_;
+        }
+        logFile_->waitDurable(offset);
+    }
+
+    Stats stats() const {
+        Stats stats;
+        stats.recorded = recorded_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.spilled = spilled_.load(std::memory_order_relaxed);
+        stats.syncs = logFile_->syncCount();
+        stats.compressed = logFile_->compressedCount();
+        for (const auto& sink : sinks_) {
+            stats.sinkDropped += sink->dropped();
+        }
+        return stats;
+    }
+
+private:
+    // Fixed-size slot in the async ring. Producers only copy bytes and take the clock;
+    // the timestamp is formatted on the writer thread. A record longer than kPayload continues
+    // in the data of the slots claimed right after its first; slotsFor says how many it takes.
+    struct AsyncRecord {
+        static constexpr std::size_t kPayload = 236;
+
+        std::int64_t order; // monotonic nanoseconds; merge order across producer threads
+        std::int64_t time;  // system_clock ticks for text, the same as order for binary events
+        std::uint32_t length;
+        char data[kPayload];
+
+        static std::size_t slotsFor(std::size_t length) {
+            return length <= kPayload ? 1 : (length + kPayload - 1) / kPayload;
+        }
+    };
+
+    struct SpilledRecord {
+        std::int64_t order;
+        std::int64_t time;
+        std::string data;
+    };
+
+    static constexpr std::int64_t kIdle = INT64_MAX;
+
+    // A producer thread's own ring in PER_THREAD mode. pending holds a lower bound on the
+    // merge order of the record the thread is busy queueing, so the writer knows how far it may
+    // merge without overtaking it.
+    struct ThreadBuffer {
+        explicit ThreadBuffer(std::size_t capacity) : ring(capacity) {}
+
+        MpscRing<AsyncRecord> ring;
+        alignas(64) std::atomic<std::int64_t> pending{kIdle};
+        std::atomic<bool> abandoned{false}; // the producer thread has exited
+        std::atomic<bool> detached{false};  // the recorder is gone
+    };
+
+    // A thread's buffers, one per recorder it has recorded to
+    struct ThreadBuffers {
+        std::vector<std::pair<std::uint64_t, std::shared_ptr<ThreadBuffer>>> entries;
+
+        ~ThreadBuffers() {
+            for (auto& entry : entries) {
+                entry.second->abandoned.store(true);
+            }
+        }
+    };
+
+    std::string filename_;
+    std::mutex mutex_;
+    RecordFormat format_;
+    bool async_ = false;
+
+    // Binary format interning. Ids are assigned under internMutex_; each thread caches the
+    // ids it has used, so a steady-state event takes no lock. Definitions are written by
+    // whoever writes the file, just before the first event in each segment that needs them.
+    static inline std::atomic<std::uint64_t> nextInstance_{1};
+    std::uint64_t instance_ = nextInstance_.fetch_add(1);
+    std::mutex internMutex_;
+    std::unordered_map<std::string, std::uint16_t> formatIds_;
+    std::vector<std::string> formats_;
+    std::vector<bool> formatWritten_; // owned by whoever writes the file
+    std::int64_t sessionRealtime_ = 0;  // anchors of the current segment's SESSION record, likewise
+    std::int64_t sessionMonotonic_ = 0;
+
+    AsyncOptions options_;
+    std::unique_ptr<LogFile> logFile_;
+    std::string syncBatch_; // synchronous mode staging, guarded by mutex_
+    std::unique_ptr<MpscRing<AsyncRecord>> ring_;
+    std::thread writer_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::uint64_t> published_{0};
+    std::atomic<bool> writerWaiting_{false};
+    std::atomic<std::uint64_t> recorded_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> spilled_{0};
+    std::mutex spillMutex_;
+    std::vector<SpilledRecord> spill_;
+    std::string assembled_; // the writer's copy of a record that spans several slots
+    std::vector<std::unique_ptr<SinkChannel>> sinks_;
+
+    // PER_THREAD buffering. threadBuffers_ is guarded by registryMutex_; the rest is the writer's.
+    std::mutex registryMutex_;
+    std::vector<std::shared_ptr<ThreadBuffer>> threadBuffers_;
+    std::vector<std::shared_ptr<ThreadBuffer>> mergeSources_;
+    std::vector<SpilledRecord> mergeSpilled_; // spilled records not yet merged, in merge order
+
+    // waitDurable handshake with the writer thread
+    std::atomic<std::uint64_t> drainRequests_{0};
+    std::mutex drainMutex_;
+    std::condition_variable drainCv_;
+    std::uint64_t drained_ = 0;
+    std::uint64_t drainedOffset_ = 0;
+    // Requests up to drainTarget_ are served once the merge passes drainSince_ (PER_THREAD) or
+    // the shared ring has been consumed up to drainUntil_ (SHARED_RING)
+    static constexpr std::size_t kNoDrain = SIZE_MAX;
+    std::uint64_t drainTarget_ = 0;
+    std::int64_t drainSince_ = kIdle;
+    std::size_t drainUntil_ = kNoDrain;
+
+    template<typename... Args>
+    void recordBinary(std::uint16_t eventType, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= BinaryRecordEncoder::kMaxArgs, "too many args for one binary record");
+        thread_local BinaryRecordEncoder encoder;
+        PendingRecord pending(*this);
+        std::int64_t time = pending.order();
+        encoder.beginEvent(time, recordThreadId(), eventType, internFormat(format));
+        (encoder.addArg(args), ...);
+        std::string_view record = encoder.finish();
+
+        if (async_) {
+            recordAsync(time, time, record);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        appendRecord(syncBatch_, 0, record.data(), record.size());
+        flush(syncBatch_);
+    }
+
+    // Takes a record's merge order, in monotonic nanoseconds. In PER_THREAD mode it also
+    // announces for as long as it lives that the thread is mid-record, so the writer holds back
+    // anything newer until the record is queued. The announcement ends however the record ends,
+    // so a throw while encoding or publishing cannot leave the writer waiting on it for good.
+    class PendingRecord {
+    public:
+        explicit PendingRecord(DataRecorder& recorder)
+            : buffer_(recorder.async_ && !recorder.ring_ ? &recorder.localBuffer() : nullptr) {
+            if (buffer_) {
+                buffer_->pending.store(monotonicNanos());
+            }
+            // Read after the announcement, so the order is never below it
+            order_ = monotonicNanos();
+        }
+
+        ~PendingRecord() {
+            if (buffer_) {
+                buffer_->pending.store(kIdle);
+            }
+        }
+
+        PendingRecord(const PendingRecord&) = delete;
+        PendingRecord& operator=(const PendingRecord&) = delete;
+
+        std::int64_t order() const { return order_; }
+
+    private:
+        ThreadBuffer* buffer_;
+        std::int64_t order_;
+    };
+
+    ThreadBuffer& localBuffer() {
+        thread_local std::uint64_t cachedInstance = 0;
+        thread_local ThreadBuffer* cached = nullptr;
+        if (cachedInstance == instance_) {
+            return *cached;
+        }
+
+        thread_local ThreadBuffers buffers;
+        auto& entries = buffers.entries;
+        auto found = std::find_if(entries.begin(), entries.end(), [this](const auto& entry) { return entry.first == instance_; });
+        if (found == entries.end()) {
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [](const auto& entry) { return entry.second->detached.load(); }),
+                          entries.end());
+            auto buffer = std::make_shared<ThreadBuffer>(options_.capacity);
+            {
+                std::lock_guard<std::mutex> lock(registryMutex_);
+                threadBuffers_.push_back(buffer);
+            }
+            found = entries.emplace(entries.end(), instance_, std::move(buffer));
+        }
+        cachedInstance = instance_;
+        cached = found->second.get();
+        return *cached;
+    }
+
+    void recordAsync(std::int64_t order, std::int64_t time, std::string_view data) {
+        ThreadBuffer* local = ring_ ? nullptr : &localBuffer();
+        MpscRing<AsyncRecord>& ring = local ? local->ring : *ring_;
+        queueAsync(ring, order, time, data);
+        if (local) {
+            local->pending.store(kIdle);
+        }
+        wakeWriter(false);
+    }
+
+    void queueAsync(MpscRing<AsyncRecord>& ring, std::int64_t order, std::int64_t time, std::string_view data) {
+        // Records that would not fit even the empty ring take the overflow list rather than being cut short
+        std::size_t slots = AsyncRecord::slotsFor(data.size());
+        if (slots > ring.capacity()) {
+            spill(order, time, data);
+            return;
+        }
+
+        auto fill = [&](AsyncRecord& record, std::size_t slot) {
+            std::size_t offset = slot * AsyncRecord::kPayload;
+            record.order = order;
+            record.time = time;
+            record.length = static_cast<std::uint32_t>(data.size());
+            std::memcpy(record.data, data.data() + offset, std::min(AsyncRecord::kPayload, data.size() - offset));
+        };
+        while (!ring.tryEmplaceRun(slots, fill)) {
+            switch (options_.overflow) {
+                case OverflowPolicy::DROP:
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                case OverflowPolicy::SPILL:
+                    spill(order, time, data);
+                    return;
+                case OverflowPolicy::BLOCK:
+                    wakeWriter(true);
+                    std::this_thread::yield();
+                    break;
+            }
+        }
+        recorded_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void spill(std::int64_t order, std::int64_t time, std::string_view data) {
+        {
+            std::lock_guard<std::mutex> lock(spillMutex_);
+            spill_.push_back({order, time, std::string(data)});
+        }
+        spilled_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool sinksAccept(RecordLevel level) const {
+        return std::any_of(sinks_.begin(), sinks_.end(), [level](const auto& sink) { return sink->accepts(level); });
+    }
+
+    void publish(std::int64_t time, RecordLevel level, std::string_view message) {
+        for (auto& sink : sinks_) {
+            sink->offer(time, level, message);
+        }
+    }
+
+    // Producers only pay for a futex wake when the writer is actually parked
+    void wakeWriter(bool always) {
+        published_.fetch_add(1);
+        if (always || writerWaiting_.load()) {
+            published_.notify_one();
+        }
+    }
+
+    void writerLoop() {
+        std::string batch;
+        std::vector<SpilledRecord> spilled;
+        batch.reserve(options_.batchBytes + AsyncRecord::kPayload + 64);
+
+        for (;;) {
+            std::uint64_t seen = published_.load();
+            std::uint64_t requests = drainRequests_.load();
+            bool stopping = stopping_.load();
+
+            bool heldBack = false;
+            bool drainDone = true;
+            if (ring_) {
+                // Waiters' records hold ring positions claimed before their request was first seen.
+                // The ring stops at a slot that is claimed but not yet filled, so keep going until
+                // the consumer has passed all of them, not just until the ring looks empty.
+                if (requests > drained_ && drainUntil_ == kNoDrain) {
+                    drainTarget_ = requests;
+                    drainUntil_ = ring_->enqueued();
+                }
+                while (consumeRecord(*ring_, batch)) {
+                    if (batch.size() >= options_.batchBytes) {
+                        flush(batch);
+                    }
+                }
+                // Spilled records are on the list before spill() returns, so this takes every one
+                // queued before the request
+                {
+                    std::lock_guard<std::mutex> lock(spillMutex_);
+                    spilled.swap(spill_);
+                }
+                for (const auto& record : spilled) {
+                    appendRecord(batch, record.time, record.data.data(), record.data.size());
+                }
+                spilled.clear();
+                if (drainUntil_ != kNoDrain) {
+                    drainDone = ring_->dequeued() >= drainUntil_;
+                    if (drainDone) {
+                        requests = drainTarget_;
+                        drainUntil_ = kNoDrain;
+                    }
+                }
+            } else {
+                // Waiters' records are all older than the moment their request was first seen
+                if (requests > drained_ && drainSince_ == kIdle) {
+                    drainTarget_ = requests;
+                    drainSince_ = monotonicNanos();
+                }
+                std::int64_t merged = mergeThreadBuffers(batch, stopping, heldBack);
+                drainDone = merged >= drainSince_;
+                if (drainDone && drainSince_ != kIdle) {
+                    requests = drainTarget_;
+                    drainSince_ = kIdle;
+                }
+            }
+            flush(batch);
+
+            if (requests > drained_ && drainDone) {
+                {
+                    std::lock_guard<std::mutex> lock(drainMutex_);
+                    drained_ = requests;
+                    drainedOffset_ = logFile_->written();
+                }
+                drainCv_.notify_all();
+            }
+
+            if (stopping) {
+                return;
+            }
+            // Records newer than the merge point go out on the next pass, which is due at once, as
+            // do requests that arrived while an earlier one was being drained
+            if (heldBack || !drainDone || drainRequests_.load() > drained_) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            writerWaiting_.store(true);
+            if (published_.load() == seen) {
+                published_.wait(seen);
+            }
+            writerWaiting_.store(false);
+        }
+    }
+
+    // Write out queued records from every producer thread's buffer, oldest first, up to the
+    // merge point: the current time, or the start of a record some producer is still queueing
+    // if that is earlier. A record queued later is ordered after the merge point, so the file
+    // stays in order. Ordering uses the monotonic clock, so a wall clock step cannot reorder
+    // records or stall the merge. force writes everything queued regardless, for shutdown.
+    // Returns the merge point; heldBack reports whether queued records were left for later.
+    std::int64_t mergeThreadBuffers(std::string& batch, bool force, bool& heldBack) {
+        {
+            std::lock_guard<std::mutex> lock(registryMutex_);
+            mergeSources_ = threadBuffers_;
+        }
+        std::int64_t watermark = monotonicNanos();
+        for (const auto& buffer : mergeSources_) {
+            watermark = std::min(watermark, buffer->pending.load());
+        }
+        if (force) {
+            watermark = kIdle;
+        }
+        {
+            std::lock_guard<std::mutex> lock(spillMutex_);
+            if (!spill_.empty()) {
+                for (auto& record : spill_) {
+                    mergeSpilled_.push_back(std::move(record));
+                }
+                spill_.clear();
+                std::stable_sort(mergeSpilled_.begin(), mergeSpilled_.end(),
+                                 [](const SpilledRecord& a, const SpilledRecord& b) { return a.order < b.order; });
+            }
+        }
+
+        std::size_t spilledUsed = 0;
+        heldBack = false;
+        for (;;) {
+            ThreadBuffer* oldest = nullptr;
+            std::int64_t oldestOrder = kIdle;
+            for (const auto& buffer : mergeSources_) {
+                const AsyncRecord* head = buffer->ring.peek();
+                if (head && head->order < oldestOrder) {
+                    oldest = buffer.get();
+                    oldestOrder = head->order;
+                }
+            }
+            bool fromSpill = spilledUsed < mergeSpilled_.size() && mergeSpilled_[spilledUsed].order <= oldestOrder;
+            if (fromSpill) {
+                oldestOrder = mergeSpilled_[spilledUsed].order;
+            } else if (!oldest) {
+                break;
+            }
+            if (oldestOrder > watermark) {
+                heldBack = true;
+                break;
+            }
+
+            if (fromSpill) {
+                const SpilledRecord& record = mergeSpilled_[spilledUsed++];
+                appendRecord(batch, record.time, record.data.data(), record.data.size());
+            } else {
+                consumeRecord(oldest->ring, batch);
+            }
+            if (batch.size() >= options_.batchBytes) {
+                flush(batch);
+            }
+        }
+        mergeSpilled_.erase(mergeSpilled_.begin(), mergeSpilled_.begin() + static_cast<std::ptrdiff_t>(spilledUsed));
+
+        // Forget buffers whose threads have exited once they are empty
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        threadBuffers_.erase(std::remove_if(threadBuffers_.begin(), threadBuffers_.end(), [](const auto& buffer) {
+            return buffer->abandoned.load() && !buffer->ring.peek();
+        }), threadBuffers_.end());
+        mergeSources_.clear();
+        return watermark;
+    }
+
+    // Take the oldest record from ring, with any slots it continues into, and stage it in batch.
+    // Those slots were published before the first, so they are all there once it is.
+    bool consumeRecord(MpscRing<AsyncRecord>& ring, std::string& batch) {
+        std::int64_t time = 0;
+        std::size_t length = 0;
+        bool consumed = ring.tryConsume([&](AsyncRecord& record) {
+            time = record.time;
+            length = record.length;
+            if (length <= AsyncRecord::kPayload) {
+                appendRecord(batch, time, record.data, length);
+            } else {
+                assembled_.assign(record.data, AsyncRecord::kPayload);
+            }
+        });
+        if (!consumed || length <= AsyncRecord::kPayload) {
+            return consumed;
+        }
+        while (assembled_.size() < length) {
+            ring.tryConsume([&](AsyncRecord& record) {
+                assembled_.append(record.data, std::min(AsyncRecord::kPayload, length - assembled_.size()));
+            });
+        }
+        appendRecord(batch, time, assembled_.data(), length);
+        return true;
+    }
+
+    // Stage one record in batch, moving to a new segment first if it would overflow this one.
+    // Text records are timestamped here; binary records carry their own timestamp.
+    void appendRecord(std::string& batch, std::int64_t time, const char* data, std::size_t length) {
+        if (logFile_->shouldRotate(batch.size() + length + TimestampCache::kMaxLength + 4)) {
+            flush(batch);
+            logFile_->rotate();
+            startSegment(batch);
+        }
+
+        if (format_ == RecordFormat::BINARY) {
+            // Index binary events by the same realtime ve-logcat derives from the session anchor
+            std::int64_t monotonic = eventMonotonicNanos(data, length);
+            int formatId = eventFormatId(data, length);
+            logFile_->index(batch.size(), sessionRealtime_ + (monotonic - sessionMonotonic_), formatId >= 0 && !formatDefined(formatId));
+            writeBinary(std::string_view(data, length), [&batch](std::string_view bytes) {
+                batch.append(bytes);
+            });
+            return;
+        }
+        std::chrono::system_clock::time_point timePoint{std::chrono::system_clock::duration(time)};
+        logFile_->index(batch.size(), std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint.time_since_epoch()).count(), false);
+        batch.append(TimestampCache::view(timePoint, options_.precision)).append(" - ").append(data, length).push_back('\n');
+    }
+
+    // Binary segments each open with a session record and define their formats afresh,
+    // so any one segment decodes on its own
+    void startSegment(std::string& batch) {
+        if (format_ == RecordFormat::BINARY) {
+            sessionRealtime_ = std::chrono::system_clock::now().time_since_epoch() / std::chrono::nanoseconds(1);
+            sessionMonotonic_ = monotonicNanos();
+            BinaryRecordEncoder encoder;
+            encoder.beginSession(sessionRealtime_, sessionMonotonic_);
+            batch.append(encoder.finish());
+            formatWritten_.assign(formatWritten_.size(), false);
+        }
+    }
+
+    void flush(std::string& batch) {
+        logFile_->write(batch);
+        batch.clear();
+    }
+
+    std::uint16_t internFormat(const char* format) {
+        thread_local std::uint64_t cachedInstance = 0;
+        thread_local std::unordered_map<const char*, std::uint16_t> cachedIds;
+        if (cachedInstance != instance_) {
+            cachedIds.clear();
+            cachedInstance = instance_;
+        }
+        auto cached = cachedIds.find(format);
+        if (cached != cachedIds.end()) {
+            return cached->second;
+        }
+
+        std::lock_guard<std::mutex> lock(internMutex_);
+        auto [it, inserted] = formatIds_.try_emplace(format, static_cast<std::uint16_t>(formats_.size()));
+        if (inserted) {
+            if (formats_.size() > UINT16_MAX) {
+                formatIds_.erase(it);
+                throw std::length_error("Too many distinct record formats");
+            }
+            formats_.emplace_back(format);
+        }
+        cachedIds.emplace(format, it->second);
+        return it->second;
+    }
+
+    // Write one binary record through out, preceded by its format definition on first use.
+    // Called by the single writer thread, or under mutex_ in synchronous mode.
+    template<typename Out>
+    void writeBinary(std::string_view record, Out&& out) {
+        int formatId = eventFormatId(record.data(), record.size());
+        if (formatId >= 0 && !formatDefined(formatId)) {
+            BinaryRecordEncoder encoder;
+            {
+                std::lock_guard<std::mutex> lock(internMutex_);
+                encoder.beginFormat(static_cast<std::uint16_t>(formatId), formats_[formatId]);
+            }
+            out(encoder.finish());
+            if (static_cast<std::size_t>(formatId) >= formatWritten_.size()) {
+                formatWritten_.resize(formatId + 1, false);
+            }
+            formatWritten_[formatId] = true;
+        }
+        out(record);
+    }
+
+    bool formatDefined(int formatId) const {
+        return static_cast<std::size_t>(formatId) < formatWritten_.size() && formatWritten_[formatId];
+    }
+
+    template<typename T>
+    static void appendText(std::string& out, const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            out.append(value ? "true" : "false");
+        } else if constexpr (std::is_arithmetic_v<T>) {
+            out.append(std::to_string(value));
+        } else {
+            out.append(std::string_view(value));
+        }
+    }
+
+    template<typename... Args>
+    static std::string renderText(std::string_view format, const Args&... args) {
+        std::string out;
+        auto emit = [&](const auto& value) {
+            auto placeholder = format.find("{}");
+            out.append(format.substr(0, placeholder));
+            if (placeholder == std::string_view::npos) {
+                format = {};
+                out.push_back(' ');
+            } else {
+                format.remove_prefix(placeholder + 2);
+            }
+            appendText(out, value);
+        };
+        (emit(args), ...);
+        out.append(format);
+        return out;
+    }
+};
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include "DataRecorder.h"
+#include "BenchmarkSupport.h"
+
+// Throughput and producer latency of DataRecorder across thread counts, record sizes and modes.
+// Results go to stdout as CSV (or JSON lines with --json), one row per run; progress goes to stderr.
+
+enum class RecorderMode {
+    SYNC,
+    ASYNC, // shared ring
+    LOCAL  // async with per-thread buffers
+};
+
+// Heap allocations made by the current thread, to check the producer path allocates nothing.
+// The library's operator delete frees with std::free, so only new needs replacing.
+thread_local std::uint64_t threadAllocations = 0;
+
+void* operator new(std::size_t size) {
+    ++threadAllocations;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+struct RecorderBenchOptions {
+    std::vector<int> threads = {1, 2, 4, 8, 16, 32, 64};
+    std::vector<std::size_t> sizes = {32, 256, 1024, 4096};
+    std::vector<RecorderMode> modes = {RecorderMode::SYNC, RecorderMode::ASYNC, RecorderMode::LOCAL};
+    std::uint64_t records = 200000; // per run, split across the producer threads
+    RecordFormat format = RecordFormat::TEXT;
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    bool json = false;
+};
+
+struct RecorderBenchResult {
+    RecorderMode mode;
+    int threads;
+    std::size_t recordBytes;
+    std::uint64_t records;
+    double produceSeconds; // until every producer returned
+    double totalSeconds;   // until every record reached the file
+    std::int64_t p50;
+    std::int64_t p99;
+    std::int64_t p999;
+    std::int64_t max;
+    DataRecorder::Stats stats;
+    std::uint64_t fileBytes;
+    std::uint64_t allocations; // by producers inside the timed loop
+};
+
+const char* modeToString(RecorderMode mode) {
+    switch (mode) {
+        case RecorderMode::SYNC: return "sync";
+        case RecorderMode::ASYNC: return "async";
+        case RecorderMode::LOCAL: return "local";
+    }
+    return "unknown";
+}
+
+RecorderBenchResult runRecorderBench(const RecorderBenchOptions& options, RecorderMode mode, int threads, std::size_t recordBytes) {
+    using Clock = std::chrono::steady_clock;
+
+    std::ostringstream name;
+    name << "ve-recorder-bench-" << modeToString(mode) << '-' << threads << '-' << recordBytes << ".log";
+    std::filesystem::path path = options.directory / name.str();
+    std::filesystem::remove(path);
+    std::filesystem::remove(dataLogIndexPath(path.string()));
+
+    // Every thread records at least once, so a run never ends up empty
+    std::uint64_t perThread = std::max<std::uint64_t>(1, options.records / static_cast<std::uint64_t>(threads));
+    std::vector<LatencyRecorder> latencies(threads);
+    for (auto& latency : latencies) {
+        latency.reserve(perThread);
+    }
+
+    // Sync text mode echoes every record to stdout through a ConsoleSink; keep that out of the terminal and the results
+    // The old buffer is put back however the run ends, so a throw cannot leave std::cout on
+    // a buffer that is gone
+    NullBuffer nullBuffer;
+    struct RestoreStdout {
+        std::streambuf* buffer;
+        ~RestoreStdout() { std::cout.rdbuf(buffer); }
+    } restoreStdout{std::cout.rdbuf(&nullBuffer)};
+
+    RecorderBenchResult result{};
+    Clock::time_point start;
+    Clock::time_point produced;
+    {
+        std::unique_ptr<DataRecorder> recorder;
+        if (mode != RecorderMode::SYNC) {
+            AsyncOptions asyncOptions;
+            asyncOptions.format = options.format;
+            if (mode == RecorderMode::LOCAL) {
+                asyncOptions.buffering = AsyncBuffering::PER_THREAD;
+                asyncOptions.capacity = 1024;
+            }
+            recorder = std::make_unique<DataRecorder>(path.string(), asyncOptions);
+        } else {
+            recorder = std::make_unique<DataRecorder>(path.string(), options.format);
+        }
+
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false};
+        std::atomic<std::uint64_t> allocations{0};
+        std::vector<std::thread> producers;
+        for (int t = 0; t < threads; ++t) {
+            producers.emplace_back([&, t]() {
+                std::string payload(recordBytes, static_cast<char>('a' + t % 26));
+                // One untimed record sets up the thread's buffers and caches
+                recorder->recordData(payload);
+                ready.fetch_add(1);
+                while (!go.load()) {
+                    std::this_thread::yield();
+                }
+                LatencyRecorder& latency = latencies[t];
+                std::uint64_t allocationsBefore = threadAllocations;
+                for (std::uint64_t i = 0; i < perThread; ++i) {
+                    auto recordStart = Clock::now();
+                    recorder->recordData(payload);
+                    latency.record(Clock::now() - recordStart);
+                }
+                allocations.fetch_add(threadAllocations - allocationsBefore);
+            });
+        }
+        while (ready.load() < threads) {
+            std::this_thread::yield();
+        }
+        start = Clock::now();
+        go.store(true);
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        produced = Clock::now();
+        result.stats = recorder->stats();
+        result.allocations = allocations.load();
+    }
+    auto finished = Clock::now();
+
+    LatencyRecorder merged;
+    merged.reserve(perThread * static_cast<std::uint64_t>(threads));
+    for (const auto& latency : latencies) {
+        merged.merge(latency);
+    }
+
+    result.mode = mode;
+    result.threads = threads;
+    result.recordBytes = recordBytes;
+    result.records = merged.count();
+    result.produceSeconds = std::chrono::duration<double>(produced - start).count();
+    result.totalSeconds = std::chrono::duration<double>(finished - start).count();
+    result.p50 = merged.percentile(0.50);
+    result.p99 = merged.percentile(0.99);
+    result.p999 = merged.percentile(0.999);
+    result.max = merged.percentile(1.0);
+    result.fileBytes = std::filesystem::file_size(path);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(dataLogIndexPath(path.string()));
+    return result;
+}
+
+void printResult(const RecorderBenchResult& result, const RecorderBenchOptions& options, std::ostream& out) {
+    double recordsPerSecond = static_cast<double>(result.records) / result.totalSeconds;
+    double megabytesPerSecond = static_cast<double>(result.fileBytes) / result.totalSeconds / 1e6;
+    double allocationsPerRecord = static_cast<double>(result.allocations) / static_cast<double>(result.records);
+    const char* format = options.format == RecordFormat::BINARY ? "binary" : "text";
+    out << std::fixed;
+    if (options.json) {
+        out << "{\"mode\":\"" << modeToString(result.mode) << "\",\"format\":\"" << format
+            << "\",\"threads\":" << result.threads << ",\"record_bytes\":" << result.recordBytes
+            << ",\"records\":" << result.records << std::setprecision(6)
+            << ",\"produce_seconds\":" << result.produceSeconds << ",\"total_seconds\":" << result.totalSeconds
+            << std::setprecision(0) << ",\"records_per_sec\":" << recordsPerSecond
+            << std::setprecision(2) << ",\"mb_per_sec\":" << megabytesPerSecond
+            << ",\"p50_ns\":" << result.p50 << ",\"p99_ns\":" << result.p99 << ",\"p999_ns\":" << result.p999
+            << ",\"max_ns\":" << result.max << ",\"dropped\":" << result.stats.dropped
+            << ",\"spilled\":" << result.stats.spilled
+            << ",\"sink_dropped\":" << result.stats.sinkDropped
+            << std::setprecision(3) << ",\"allocs_per_record\":" << allocationsPerRecord << "}\n";
+    } else {
+        out << modeToString(result.mode) << ',' << format << ',' << result.threads << ',' << result.recordBytes << ','
+            << result.records << ',' << std::setprecision(6) << result.produceSeconds << ',' << result.totalSeconds << ','
+            << std::setprecision(0) << recordsPerSecond << ',' << std::setprecision(2) << megabytesPerSecond << ','
+            << result.p50 << ',' << result.p99 << ',' << result.p999 << ',' << result.max << ','
+            << result.stats.dropped << ',' << result.stats.spilled << ',' << result.stats.sinkDropped << ','
+            << std::setprecision(3) << allocationsPerRecord << '\n';
+    }
+    out << std::flush;
+}
+
+template<typename T>
+std::vector<T> parseList(const std::string& text) {
+    std::vector<T> values;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(static_cast<T>(std::stoull(item)));
+    }
+    if (values.empty()) {
+        throw std::invalid_argument("Empty list: " + text);
+    }
+    return values;
+}
+
+void printUsage() {
+    std::cerr << "Usage: DataRecorderBench [--threads 1,2,4,...] [--sizes 32,256,...] [--modes sync,async,local]\n"
+              << "                         [--records N] [--binary] [--dir PATH] [--json]\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        RecorderBenchOptions options;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--threads" && hasValue) {
+                options.threads = parseList<int>(argv[++i]);
+            } else if (arg == "--sizes" && hasValue) {
+                options.sizes = parseList<std::size_t>(argv[++i]);
+            } else if (arg == "--modes" && hasValue) {
+                std::istringstream modes(argv[++i]);
+                std::string mode;
+                options.modes.clear();
+                while (std::getline(modes, mode, ',')) {
+                    if (mode == "sync") {
+                        options.modes.push_back(RecorderMode::SYNC);
+                    } else if (mode == "async") {
+                        options.modes.push_back(RecorderMode::ASYNC);
+                    } else if (mode == "local") {
+                        options.modes.push_back(RecorderMode::LOCAL);
+                    } else {
+                        throw std::invalid_argument("Unknown mode " + mode);
+                    }
+                }
+            } else if (arg == "--records" && hasValue) {
+                options.records = std::stoull(argv[++i]);
+            } else if (arg == "--dir" && hasValue) {
+                options.directory = argv[++i];
+            } else if (arg == "--binary") {
+                options.format = RecordFormat::BINARY;
+            } else if (arg == "--json") {
+                options.json = true;
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+        if (options.modes.empty()) {
+            throw std::invalid_argument("No modes selected");
+        }
+        for (int threads : options.threads) {
+            if (threads < 1) {
+                throw std::invalid_argument("Threads must be at least 1");
+            }
+        }
+
+        std::ios::sync_with_stdio(false);
+        if (!options.json) {
+            std::cout << "mode,format,threads,record_bytes,records,produce_seconds,total_seconds,records_per_sec,"
+                         "mb_per_sec,p50_ns,p99_ns,p999_ns,max_ns,dropped,spilled,sink_dropped,allocs_per_record\n";
+        }
+        // The async producer path must not allocate; sync mode builds the batch on the caller's thread
+        bool allocated = false;
+        for (RecorderMode mode : options.modes) {
+            for (int threads : options.threads) {
+                for (std::size_t size : options.sizes) {
+                    std::cerr << modeToString(mode) << ' ' << threads << " threads, " << size << " B records..." << std::endl;
+                    RecorderBenchResult result = runRecorderBench(options, mode, threads, size);
+                    printResult(result, options, std::cout);
+                    if (mode != RecorderMode::SYNC && result.allocations > 0) {
+                        std::cerr << "FAIL: " << result.allocations << " producer allocations in " << modeToString(mode)
+                                  << " mode with " << size << " B records" << std::endl;
+                        allocated = true;
+                    }
+                }
+            }
+        }
+        if (allocated) {
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "MpscRing.h"
+#include "TimestampCache.h"
+
+// Extra destinations for DataRecorder records, next to its own log file.
+//
+// Every sink sits behind its own SinkChannel: a bounded lock-free queue drained by a thread
+// that belongs to that sink alone. Producers only filter and copy into the queue, and when a
+// sink falls behind its queue fills and further records for it are dropped and counted, so a
+// slow terminal or pipe never holds up producers, the log file or the other sinks.
+
+enum class RecordLevel : std::uint8_t {
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR
+};
+
+inline std::string_view recordLevelName(RecordLevel level) {
+    switch (level) {
+        case RecordLevel::DEBUG: return "DEBUG";
+        case RecordLevel::INFO: return "INFO";
+        case RecordLevel::WARNING: return "WARNING";
+        case RecordLevel::ERROR: return "ERROR";
+    }
+    return "UNKNOWN";
+}
+
+// One record as a sink sees it
+struct SinkRecord {
+    static constexpr std::size_t kPayload = 1000;
+
+    std::int64_t time; // system_clock ticks
+    RecordLevel level;
+    bool truncated;    // the message was longer than kPayload and was cut short
+    std::uint32_t length;
+    char data[kPayload];
+
+    std::string_view message() const { return std::string_view(data, length); }
+    std::chrono::system_clock::time_point timePoint() const {
+        return std::chrono::system_clock::time_point{std::chrono::system_clock::duration(time)};
+    }
+};
+
+class DataSink {
+public:
+    virtual ~DataSink() = default;
+
+    // Called on the sink's own thread, one record at a time
+    virtual void write(const SinkRecord& record) = 0;
+
+    // Called once the sink's queue has been drained, before its thread parks
+    virtual void flush() {}
+};
+
+struct SinkOptions {
+    RecordLevel minLevel = RecordLevel::DEBUG;
+    double sampleRate = 1.0;     // fraction of passing records delivered, chosen at random per record
+    std::size_t capacity = 1024; // queue slots, rounded up to a power of two
+};
+
+// A sink with its queue, filters and delivery thread
+class SinkChannel {
+public:
+    SinkChannel(std::shared_ptr<DataSink> sink, const SinkOptions& options)
+        : sink_(std::move(sink)), options_(options), ring_(options.capacity) {
+        thread_ = std::thread(&SinkChannel::run, this);
+    }
+
+    ~SinkChannel() {
+        stopping_.store(true);
+        wake(true);
+        thread_.join();
+    }
+
+    SinkChannel(const SinkChannel&) = delete;
+    SinkChannel& operator=(const SinkChannel&) = delete;
+
+    bool accepts(RecordLevel level) const { return level >= options_.minLevel; }
+
+    // Queue a record for the sink unless it is filtered out. Never blocks.
+    void offer(std::int64_t time, RecordLevel level, std::string_view message) {
+        offerInPlace(time, level, [message](SinkRecord& record) {
+            record.truncated = message.size() > SinkRecord::kPayload;
+            record.length = static_cast<std::uint32_t>(std::min(message.size(), SinkRecord::kPayload));
+            std::memcpy(record.data, message.data(), record.length);
+        });
+    }
+
+    // As offer, but fill(record) writes the message straight into the queue slot, setting
+    // data, length and truncated, so a caller can format it there without a copy
+    template<typename Fill>
+    void offerInPlace(std::int64_t time, RecordLevel level, Fill&& fill) {
+        if (!accepts(level) || (options_.sampleRate < 1.0 && !sampled())) {
+            return;
+        }
+        bool queued = ring_.tryEmplace([&](SinkRecord& record) {
+            record.time = time;
+            record.level = level;
+            fill(record);
+        });
+        if (!queued) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        wake(false);
+    }
+
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    std::uint64_t delivered() const { return delivered_.load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<DataSink> sink_;
+    SinkOptions options_;
+    MpscRing<SinkRecord> ring_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<std::uint64_t> published_{0};
+    std::atomic<bool> waiting_{false};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<std::uint64_t> delivered_{0};
+
+    // Per-thread xorshift, so sampling shares no state between producers
+    bool sampled() const {
+        thread_local std::uint64_t state = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<std::uintptr_t>(&state);
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<double>(state >> 11) * 0x1.0p-53 < options_.sampleRate;
+    }
+
+    void wake(bool always) {
+        published_.fetch_add(1);
+        if (always || waiting_.load()) {
+            published_.notify_one();
+        }
+    }
+
+    void run() {
+        for (;;) {
+            std::uint64_t seen = published_.load();
+            bool stopping = stopping_.load();
+            std::uint64_t delivered = 0;
+            while (ring_.tryConsume([this](SinkRecord& record) { sink_->write(record); })) {
+                ++delivered;
+            }
+            if (delivered > 0) {
+                sink_->flush();
+                delivered_.fetch_add(delivered, std::memory_order_relaxed);
+            }
+            if (stopping) {
+                return;
+            }
+            waiting_.store(true);
+            if (published_.load() == seen) {
+                published_.wait(seen);
+            }
+            waiting_.store(false);
+        }
+    }
+};
+
+// Echoes records as "Recorded: timestamp - message", the way DataRecorder always has. Lines
+// are batched until the queue drains, or until kFlushBytes are waiting so a long burst neither
+// grows the buffer without bound nor keeps the console quiet.
+class ConsoleSink : public DataSink {
+public:
+    static constexpr std::size_t kFlushBytes = 64 * 1024;
+
+    explicit ConsoleSink(std::ostream& out = std::cout) : out_(out) {}
+
+    void write(const SinkRecord& record) override {
+        buffer_.append("Recorded: ").append(TimestampCache::view(record.timePoint())).append(" - ").append(record.message());
+        buffer_.append(record.truncated ? "...\n" : "\n");
+        if (buffer_.size() >= kFlushBytes) {
+            flush();
+        }
+    }
+
+    void flush() override {
+        out_ << buffer_ << std::flush;
+        buffer_.clear();
+    }
+
+private:
+    std::ostream& out_;
+    std::string buffer_;
+};
+
+enum class FileSinkStyle {
+    PLAIN,   // "timestamp - message"
+    LEVELED  // "[timestamp] [LEVEL] message", as Logger writes
+};
+
+// Appends lines to a file of its own, e.g. a filtered copy of the log
+class FileSink : public DataSink {
+public:
+    explicit FileSink(const std::string& path, TimestampPrecision precision = TimestampPrecision::SECONDS,
+                      FileSinkStyle style = FileSinkStyle::PLAIN)
+        : file_(path, std::ios::out | std::ios::app), precision_(precision), style_(style) {
+        if (!file_.is_open()) {
+            throw std::runtime_error("Could not open sink file " + path);
+        }
+    }
+
+    void write(const SinkRecord& record) override {
+        if (style_ == FileSinkStyle::LEVELED) {
+            file_ << '[' << TimestampCache::view(record.timePoint(), precision_) << "] [" << recordLevelName(record.level)
+                  << "] " << record.message();
+        } else {
+            file_ << TimestampCache::view(record.timePoint(), precision_) << " - " << record.message();
+        }
+        file_ << (record.truncated ? "...\n" : "\n");
+    }
+
+    void flush() override { file_.flush(); }
+
+private:
+    std::ofstream file_;
+    TimestampPrecision precision_;
+    FileSinkStyle style_;
+};
+
+// Keeps the most recent records in a fixed in-memory buffer, to be dumped after the fact,
+// in particular from a crash handler (see installCrashHandler)
+class MemoryRingSink : public DataSink {
+public:
+    explicit MemoryRingSink(std::size_t capacityBytes = 1 << 20) : buffer_(std::max<std::size_t>(capacityBytes, 256)) {}
+
+    ~MemoryRingSink() override {
+        for (auto& slot : crashRings()) {
+            MemoryRingSink* expected = this;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+    }
+
+    void write(const SinkRecord& record) override {
+        char timestamp[TimestampCache::kMaxLength];
+        std::size_t timestampLength = TimestampCache::format(record.timePoint(), TimestampPrecision::MILLISECONDS, timestamp);
+        append(timestamp, timestampLength);
+        append(" - ", 3);
+        append(record.data, record.length);
+        append(record.truncated ? "...\n" : "\n", record.truncated ? 4 : 1);
+        written_.store(total_, std::memory_order_release);
+    }
+
+    // Write the retained records, oldest first, to fd. Only calls write(2), so it is safe in a
+    // signal handler; a record being appended at that moment may come out torn.
+    void dump(int fd) const {
+        std::uint64_t total = written_.load(std::memory_order_acquire);
+        std::size_t size = buffer_.size();
+        if (total <= size) {
+            writeFd(fd, buffer_.data(), static_cast<std::size_t>(total));
+            return;
+        }
+        // The oldest bytes were overwritten mid-record; start at the next full line
+        std::size_t start = static_cast<std::size_t>(total % size);
+        std::size_t skip = start;
+        while (skip < size && buffer_[skip] != '\n') {
+            ++skip;
+        }
+        if (skip < size) {
+            writeFd(fd, buffer_.data() + skip + 1, size - skip - 1);
+            writeFd(fd, buffer_.data(), start);
+        } else {
+            writeFd(fd, buffer_.data(), start);
+        }
+    }
+
+    // Dump this ring to stderr if the process dies on SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT
+    void installCrashHandler() {
+        for (auto& slot : crashRings()) {
+            if (slot.load() == this) {
+                return;
+            }
+        }
+        for (auto& slot : crashRings()) {
+            MemoryRingSink* expected = nullptr;
+            if (slot.compare_exchange_strong(expected, this)) {
+                static const bool installed = [] {
+                    for (int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+                        struct sigaction action {};
+                        action.sa_handler = &MemoryRingSink::onCrash;
+                        sigemptyset(&action.sa_mask);
+                        action.sa_flags = SA_RESETHAND;
+                        sigaction(signal, &action, nullptr);
+                    }
+                    return true;
+                }();
+                (void)installed;
+                return;
+            }
+        }
+        throw std::length_error("Too many crash-dumped memory rings");
+    }
+
+private:
+    std::vector<char> buffer_;
+    std::uint64_t total_ = 0;                // sink thread only
+    std::atomic<std::uint64_t> written_{0}; // total_ as of the last complete record, for dump
+
+    static constexpr std::size_t kMaxCrashRings = 8;
+
+    static std::array<std::atomic<MemoryRingSink*>, kMaxCrashRings>& crashRings() {
+        static std::array<std::atomic<MemoryRingSink*>, kMaxCrashRings> rings{};
+        return rings;
+    }
+
+    void append(const char* data, std::size_t length) {
+        std::size_t size = buffer_.size();
+        while (length > 0) {
+            std::size_t position = static_cast<std::size_t>(total_ % size);
+            std::size_t count = std::min(length, size - position);
+            std::memcpy(buffer_.data() + position, data, count);
+            total_ += count;
+            data += count;
+            length -= count;
+        }
+    }
+
+    static void writeFd(int fd, const char* data, std::size_t length) {
+        while (length > 0) {
+            ssize_t count = ::write(fd, data, length);
+            if (count <= 0) {
+                return;
+            }
+            data += count;
+            length -= static_cast<std::size_t>(count);
+        }
+    }
+
+    static void onCrash(int signal) {
+        static const char header[] = "\n--- recent records ---\n";
+        for (auto& slot : crashRings()) {
+            MemoryRingSink* ring = slot.load();
+            if (ring) {
+                writeFd(STDERR_FILENO, header, sizeof(header) - 1);
+                ring->dump(STDERR_FILENO);
+            }
+        }
+        // SA_RESETHAND restored the default action; die the way we were going to
+        ::raise(signal);
+    }
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Process-wide pool of response buffers in power-of-two size classes from 4 KB to 16 MB.
+// Released buffers are kept for the next response of a similar size, up to a byte budget,
+// so once the pool is warm downloading a body allocates nothing. Bodies above the largest
+// class get a buffer of their own that is freed on release.
+class HttpBufferPool {
+public:
+    static constexpr std::size_t kMinClassBytes = 4096;
+    static constexpr std::size_t kClasses = 13; // 4 KB << 12 = 16 MB
+    static constexpr std::size_t kMaxClassBytes = kMinClassBytes << (kClasses - 1);
+
+    struct Stats {
+        std::uint64_t allocated = 0; // buffers taken from the heap
+        std::uint64_t reused = 0;    // buffers handed out again from the pool
+        std::size_t retainedBytes = 0;
+    };
+
+    static HttpBufferPool& instance() {
+        static HttpBufferPool pool;
+        return pool;
+    }
+
+    HttpBufferPool(const HttpBufferPool&) = delete;
+    HttpBufferPool& operator=(const HttpBufferPool&) = delete;
+
+    // Bytes the pool keeps idle at most; buffers released beyond it are freed
+    void setRetainLimit(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retainLimit_ = bytes;
+    }
+
+    // The capacity acquire(bytes) hands out
+    static std::size_t capacityFor(std::size_t bytes) {
+        if (bytes > kMaxClassBytes) {
+            return bytes;
+        }
+        std::size_t capacity = kMinClassBytes;
+        while (capacity < bytes) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    // A buffer of capacityFor(bytes) bytes
+    char* acquire(std::size_t bytes) {
+        std::size_t capacity = capacityFor(bytes);
+        if (capacity <= kMaxClassBytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& free = free_[classOf(capacity)];
+            if (!free.empty()) {
+                char* buffer = free.back();
+                free.pop_back();
+                retained_ -= capacity;
+                ++stats_.reused;
+                return buffer;
+            }
+            ++stats_.allocated;
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.allocated;
+        }
+        return new char[capacity];
+    }
+
+    // Return a buffer from acquire() with the capacity it was handed out with
+    void release(char* buffer, std::size_t capacity) {
+        if (!buffer) {
+            return;
+        }
+        if (capacity <= kMaxClassBytes) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (retained_ + capacity <= retainLimit_) {
+                free_[classOf(capacity)].push_back(buffer);
+                retained_ += capacity;
+                return;
+            }
+        }
+        delete[] buffer;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats stats = stats_;
+        stats.retainedBytes = retained_;
+        return stats;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::array<std::vector<char*>, kClasses> free_;
+    std::size_t retained_ = 0;
+    std::size_t retainLimit_ = 64u << 20;
+    Stats stats_;
+
+    HttpBufferPool() = default;
+
+    ~HttpBufferPool() {
+        for (auto& free : free_) {
+            for (char* buffer : free) {
+                delete[] buffer;
+            }
+        }
+    }
+
+    static std::size_t classOf(std::size_t capacity) {
+        std::size_t index = 0;
+        while ((kMinClassBytes << index) < capacity) {
+            ++index;
+        }
+        return index;
+    }
+};
+
+// A response body in a pooled buffer. Move-only; the buffer goes back to HttpBufferPool when
+// the body is destroyed, so callers read it through view() rather than copying it out.
+class HttpBody {
+public:
+    HttpBody() = default;
+
+    ~HttpBody() { reset(); }
+
+    HttpBody(HttpBody&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          capacity_(std::exchange(other.capacity_, 0)) {}
+
+    HttpBody& operator=(HttpBody&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            capacity_ = std::exchange(other.capacity_, 0);
+        }
+        return *this;
+    }
+
+    HttpBody(const HttpBody&) = delete;
+    HttpBody& operator=(const HttpBody&) = delete;
+
+    std::string_view view() const { return std::string_view(data_, size_); }
+    operator std::string_view() const { return view(); }
+    std::string str() const { return std::string(view()); }
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Make room for bytes in total, e.g. from a Content-Length, so appends do not regrow
+    void reserve(std::size_t bytes) {
+        if (bytes <= capacity_) {
+            return;
+        }
+        HttpBufferPool& pool = HttpBufferPool::instance();
+        std::size_t capacity = HttpBufferPool::capacityFor(bytes);
+        char* data = pool.acquire(capacity);
+        if (size_ > 0) {
+            std::memcpy(data, data_, size_);
+        }
+        pool.release(data_, capacity_);
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    void append(const char* bytes, std::size_t length) {
+        if (length == 0) {
+            return;
+        }
+        if (size_ + length > capacity_) {
+            reserve(std::max(size_ + length, capacity_ * 2));
+        }
+        std::memcpy(data_ + size_, bytes, length);
+        size_ += length;
+    }
+
+    // Give the buffer back to the pool
+    void reset() {
+        HttpBufferPool::instance().release(data_, capacity_);
+        data_ = nullptr;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+private:
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+};
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+struct HttpCacheOptions {
+    std::size_t maxBytes = 32u << 20; // bodies and headers kept in memory; least recently used go first
+    std::string directory;            // when set, entries are also written here and survive restarts
+};
+
+// One cached response. The body and validators never change once cached; a 304 only moves
+// the expiry, so whatever was parsed from the body stays valid and is handed out again.
+class HttpCacheEntry {
+public:
+    HttpCacheEntry(std::string url, long status, std::string body, std::string etag, std::string lastModified,
+                   std::int64_t expiresMs)
+        : url_(std::move(url)), status_(status), body_(std::move(body)), etag_(std::move(etag)),
+          lastModified_(std::move(lastModified)), expiresMs_(expiresMs) {}
+
+    const std::string& url() const { return url_; }
+    long status() const { return status_; }
+    std::string_view body() const { return body_; }
+    const std::string& etag() const { return etag_; }
+    const std::string& lastModified() const { return lastModified_; }
+
+    // Milliseconds since the epoch after which the entry must be revalidated
+    std::int64_t expiresMs() const { return expiresMs_.load(std::memory_order_relaxed); }
+    bool fresh(std::int64_t nowMs) const { return nowMs < expiresMs(); }
+
+    // parse(body()) run once per entry, e.g. to a JSON document; later calls, including after
+    // a 304, return the same object. A different T replaces what was kept.
+    template <typename T, typename Parse>
+    std::shared_ptr<const T> parsed(Parse parse) const {
+        std::lock_guard<std::mutex> lock(parsedMutex_);
+        if (parsed_ && *parsedType_ == typeid(T)) {
+            return std::static_pointer_cast<const T>(parsed_);
+        }
+        auto value = std::make_shared<const T>(parse(body()));
+        parsed_ = value;
+        parsedType_ = &typeid(T);
+        return value;
+    }
+
+    std::size_t bytes() const {
+        return sizeof(*this) + url_.size() + body_.size() + etag_.size() + lastModified_.size();
+    }
+
+private:
+    friend class HttpCache;
+
+    std::string url_;
+    long status_;
+    std::string body_;
+    std::string etag_;
+    std::string lastModified_;
+    mutable std::atomic<std::int64_t> expiresMs_; // the one field a 304 updates
+
+    mutable std::mutex parsedMutex_;
+    mutable std::shared_ptr<const void> parsed_;
+    mutable const std::type_info* parsedType_ = nullptr;
+};
+
+// A size-bounded LRU cache of HTTP responses keyed by URL, shared by any number of clients
+// and threads. With HttpCacheOptions::directory set, every cached entry is mirrored to a file
+// there and read back on a miss, so a restart can revalidate instead of downloading again.
+class HttpCache {
+public:
+    struct Stats {
+        std::uint64_t hits = 0;          // served while fresh, without a request
+        std::uint64_t revalidations = 0; // 304 Not Modified, served from the cache
+        std::uint64_t misses = 0;        // downloaded in full
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    explicit HttpCache(const HttpCacheOptions& options = HttpCacheOptions()) : options_(options) {}
+
+    HttpCache(const HttpCache&) = delete;
+    HttpCache& operator=(const HttpCache&) = delete;
+
+    static std::int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // The entry for url, fresh or not, or null; marks it most recently used
+    std::shared_ptr<const HttpCacheEntry> lookup(const std::string& url) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(url);
+            if (found != index_.end()) {
+                lru_.splice(lru_.begin(), lru_, found->second);
+                return *found->second;
+            }
+        }
+        if (options_.directory.empty()) {
+            return nullptr;
+        }
+        std::shared_ptr<HttpCacheEntry> entry = load(url);
+        if (entry) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            insertLocked(entry);
+        }
+        return entry;
+    }
+
+    // Cache a full response, replacing any older entry for its URL
+    std::shared_ptr<const HttpCacheEntry> store(std::string url, long status, std::string body, std::string etag,
+                                                std::string lastModified, std::int64_t expiresMs) {
+        auto entry = std::make_shared<HttpCacheEntry>(std::move(url), status, std::move(body), std::move(etag),
+                                                      std::move(lastModified), expiresMs);
+        if (entry->bytes() > options_.maxBytes) {
+            return entry; // served this once, too big to keep
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            insertLocked(entry);
+        }
+        save(*entry);
+        return entry;
+    }
+
+    // Drop url's entry, e.g. once a new response for it may not be cached
+    void erase(const std::string& url) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(url);
+            if (found == index_.end()) {
+                return;
+            }
+            bytes_ -= (*found->second)->bytes();
+            lru_.erase(found->second);
+            index_.erase(found);
+        }
+        if (!options_.directory.empty()) {
+            std::remove(pathFor(url).c_str());
+        }
+    }
+
+    // A 304 confirmed entry is current; it stays fresh until expiresMs
+    void refresh(const HttpCacheEntry& entry, std::int64_t expiresMs) {
+        entry.expiresMs_.store(expiresMs, std::memory_order_relaxed);
+        save(entry);
+    }
+
+    void countHit() { hits_.fetch_add(1, std::memory_order_relaxed); }
+    void countRevalidation() { revalidations_.fetch_add(1, std::memory_order_relaxed); }
+    void countMiss() { misses_.fetch_add(1, std::memory_order_relaxed); }
+
+    Stats stats() const {
+        Stats stats;
+        stats.hits = hits_.load(std::memory_order_relaxed);
+        stats.revalidations = revalidations_.load(std::memory_order_relaxed);
+        stats.misses = misses_.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats.evictions = evictions_;
+        stats.entries = index_.size();
+        stats.bytes = bytes_;
+        return stats;
+    }
+
+    // How long a response may be served without revalidation, from its Cache-Control header:
+    // max-age, or 0 for no-cache. Returns -1 for no-store, which must not be cached at all.
+    static std::int64_t maxAgeSeconds(std::string_view cacheControl) {
+        std::int64_t maxAge = 0;
+        bool noCache = false;
+        while (!cacheControl.empty()) {
+            std::size_t comma = cacheControl.find(',');
+            std::string_view directive = trim(cacheControl.substr(0, comma));
+            cacheControl = comma == std::string_view::npos ? std::string_view() : cacheControl.substr(comma + 1);
+            if (equalsIgnoreCase(directive, "no-store")) {
+                return -1;
+            }
+            if (equalsIgnoreCase(directive, "no-cache")) {
+                noCache = true;
+            } else if (directive.size() > 8 && equalsIgnoreCase(directive.substr(0, 8), "max-age=")) {
+                maxAge = 0;
+                for (char c : directive.substr(8)) {
+                    if (c < '0' || c > '9') {
+                        break;
+                    }
+                    maxAge = maxAge * 10 + (c - '0');
+                }
+            }
+        }
+        return noCache ? 0 : maxAge;
+    }
+
+private:
+    using Lru = std::list<std::shared_ptr<HttpCacheEntry>>;
+
+    HttpCacheOptions options_;
+    mutable std::mutex mutex_;
+    Lru lru_;
+    std::unordered_map<std::string, Lru::iterator> index_;
+    std::size_t bytes_ = 0;
+    std::uint64_t evictions_ = 0;
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> revalidations_{0};
+    std::atomic<std::uint64_t> misses_{0};
+
+    void insertLocked(const std::shared_ptr<HttpCacheEntry>& entry) {
+        auto found = index_.find(entry->url());
+        if (found != index_.end()) {
+            bytes_ -= (*found->second)->bytes();
+            lru_.erase(found->second);
+            index_.erase(found);
+        }
+        lru_.push_front(entry);
+        index_.emplace(entry->url(), lru_.begin());
+        bytes_ += entry->bytes();
+        while (bytes_ > options_.maxBytes && lru_.size() > 1) {
+            const std::shared_ptr<HttpCacheEntry>& oldest = lru_.back();
+            bytes_ -= oldest->bytes();
+            if (!options_.directory.empty()) {
+                std::remove(pathFor(oldest->url()).c_str());
+            }
+            index_.erase(oldest->url());
+            lru_.pop_back();
+            ++evictions_;
+        }
+    }
+
+    std::string pathFor(std::string_view url) const {
+        std::uint64_t hash = 14695981039346656037ull; // FNV-1a
+        for (unsigned char c : url) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.cache", static_cast<unsigned long long>(hash));
+        return options_.directory + "/" + name;
+    }
+
+    // File layout: a "VEHC1" line, then url, status, etag, last-modified, expiry and body size
+    // one per line, then the body
+    void save(const HttpCacheEntry& entry) const {
+        if (options_.directory.empty()) {
+            return;
+        }
+        std::string path = pathFor(entry.url());
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cerr << "Could not write HTTP cache file " << temporary << std::endl;
+                return;
+            }
+            file << "VEHC1\n" << entry.url() << '\n' << entry.status() << '\n' << entry.etag() << '\n'
+                 << entry.lastModified() << '\n' << entry.expiresMs() << '\n' << entry.body().size() << '\n';
+            file.write(entry.body().data(), static_cast<std::streamsize>(entry.body().size()));
+        }
+        std::rename(temporary.c_str(), path.c_str());
+    }
+
+    std::shared_ptr<HttpCacheEntry> load(const std::string& url) const {
+        std::ifstream file(pathFor(url), std::ios::binary);
+        std::string magic, storedUrl, status, etag, lastModified, expires, size;
+        if (!file || !std::getline(file, magic) || magic != "VEHC1" || !std::getline(file, storedUrl) ||
+            storedUrl != url || !std::getline(file, status) || !std::getline(file, etag) ||
+            !std::getline(file, lastModified) || !std::getline(file, expires) || !std::getline(file, size)) {
+            return nullptr;
+        }
+        try {
+            std::string body(std::stoull(size), '\0');
+            if (!file.read(body.data(), static_cast<std::streamsize>(body.size()))) {
+                return nullptr;
+            }
+            return std::make_shared<HttpCacheEntry>(url, std::stol(status), std::move(body), std::move(etag),
+                                                    std::move(lastModified), std::stoll(expires));
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    }
+
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            char x = a[i], y = b[i];
+            if (x >= 'A' && x <= 'Z') x = static_cast<char>(x - 'A' + 'a');
+            if (y >= 'A' && y <= 'Z') y = static_cast<char>(y - 'A' + 'a');
+            if (x != y) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
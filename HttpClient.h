@@ -0,0 +1,868 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#include <curl/curl.h>
+#include "HttpBufferPool.h"
+#include "HttpCache.h"
+#include "HttpMetrics.h"
+#include "JsonStream.h"
+#include "StartupProfile.h"
+
+// Process-wide libcurl state: libcurl is initialized once, and every pooled handle goes through
+// one share handle, so DNS lookups and TLS sessions are reused across handles and threads.
+// Connections are not shared, since libcurl does not support sharing its connection cache
+// between threads. A connection stays with the easy handle that opened it (HttpClient pools
+// handles per host) or with the multi handle that ran it (AsyncHttpClient).
+class HttpShare {
+public:
+    // The first call initializes libcurl; call it at startup, before any threads make requests
+    static HttpShare& instance() {
+        static HttpShare share;
+        return share;
+    }
+
+    HttpShare(const HttpShare&) = delete;
+    HttpShare& operator=(const HttpShare&) = delete;
+
+    CURLSH* handle() const { return share_; }
+
+private:
+    CURLSH* share_ = nullptr;
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> locks_;
+
+    HttpShare() {
+        StartupProfile::instance().measure("http.global_init", []() {
+            curl_global_init(CURL_GLOBAL_DEFAULT);
+        });
+        // Registered before this object finishes constructing, so it runs after ~HttpShare
+        std::atexit(curl_global_cleanup);
+
+        share_ = curl_share_init();
+        if (!share_) {
+            throw std::runtime_error("Could not create curl share handle");
+        }
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &HttpShare::lock);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &HttpShare::unlock);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    ~HttpShare() {
+        curl_share_cleanup(share_);
+    }
+
+    static void lock(CURL*, curl_lock_data data, curl_lock_access, void* user) {
+        static_cast<HttpShare*>(user)->locks_[data].lock();
+    }
+
+    static void unlock(CURL*, curl_lock_data data, void* user) {
+        static_cast<HttpShare*>(user)->locks_[data].unlock();
+    }
+};
+
+struct HttpClientOptions {
+    std::size_t maxIdlePerHost = 8;    // idle handles kept per scheme://host:port; more are closed on return
+    long connectTimeoutMs = 10000;
+    long timeoutMs = 30000;            // whole request; 0 waits forever
+    long keepAliveIdleSeconds = 60;    // TCP keep-alive probes start after this long idle
+    HttpMetrics* metrics = nullptr;    // when set, every finished request's timings go here
+    HttpCache* cache = nullptr;        // used by HttpClient::getCached
+};
+
+namespace http {
+
+// "scheme://host:port" of url; requests with the same key can reuse a connection
+inline std::string_view hostOf(std::string_view url) {
+    std::size_t start = url.find("://");
+    start = start == std::string_view::npos ? 0 : start + 3;
+    std::size_t end = url.find_first_of("/?#", start);
+    return url.substr(0, end);
+}
+
+inline std::string hostKey(std::string_view url) {
+    return std::string(hostOf(url));
+}
+
+// Lets host-keyed maps be searched with a string_view, without building a key string
+struct HostHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view host) const { return std::hash<std::string_view>()(host); }
+};
+
+// Where a transfer's body goes when it is kept: a pooled buffer sized from the
+// Content-Length when the server sends one
+struct BodySink {
+    HttpBody body;
+    CURL* handle = nullptr;
+};
+
+// Exceptions must not unwind through libcurl, so the callbacks below catch them and return 0,
+// which fails the transfer with CURLE_WRITE_ERROR
+inline size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    auto* sink = static_cast<BodySink*>(userp);
+    try {
+        if (sink->body.empty()) {
+            // The server's Content-Length is only trusted up to the largest pooled buffer;
+            // a bigger body grows as it arrives
+            curl_off_t length = -1;
+            if (curl_easy_getinfo(sink->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length > 0) {
+                sink->body.reserve(std::min(static_cast<std::size_t>(length), HttpBufferPool::kMaxClassBytes));
+            }
+        }
+        sink->body.append(static_cast<const char*>(contents), size * nmemb);
+    } catch (...) {
+        return 0;
+    }
+    return size * nmemb;
+}
+
+// Streams the body into a JsonStreamParser instead of buffering it. Returning short aborts the
+// transfer once the JSON is invalid or the handler has what it wanted.
+inline size_t JsonWriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+    auto* parser = static_cast<JsonStreamParser*>(userp);
+    try {
+        return parser->feed(std::string_view(static_cast<const char*>(contents), size * nmemb)) ? size * nmemb : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+// Point handle's output at sink, or at parser when there is one
+inline void setSink(CURL* handle, BodySink* sink, JsonStreamParser* parser) {
+    if (parser) {
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, JsonWriteCallback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, parser);
+    } else {
+        sink->handle = handle;
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, sink);
+    }
+}
+
+// The value of the last response's header name, or empty
+inline std::string_view header(CURL* handle, const char* name) {
+    curl_header* found = nullptr;
+    if (curl_easy_header(handle, name, 0, CURLH_HEADER, -1, &found) != CURLHE_OK) {
+        return {};
+    }
+    return found->value;
+}
+
+// Request headers that revalidate cached with its validators (If-None-Match,
+// If-Modified-Since), or null when there is nothing to send. Free with curl_slist_free_all.
+inline curl_slist* conditionsFor(const HttpCacheEntry* cached) {
+    curl_slist* conditions = nullptr;
+    if (cached) {
+        if (!cached->etag().empty()) {
+            conditions = curl_slist_append(conditions, ("If-None-Match: " + cached->etag()).c_str());
+        }
+        if (!cached->lastModified().empty()) {
+            conditions = curl_slist_append(conditions, ("If-Modified-Since: " + cached->lastModified()).c_str());
+        }
+    }
+    return conditions;
+}
+
+// Fold the response to a GET of url sent with conditionsFor(cached), still held by handle,
+// into cache, and return the entry to serve. On a 304 that is cached itself, and revalidated
+// is set. 200 responses are cached for their Cache-Control max-age, or kept for revalidation
+// if they carry an ETag or Last-Modified. Otherwise the response is served once, and an older
+// entry is dropped so its validators are not sent again.
+inline std::shared_ptr<const HttpCacheEntry> cacheResponse(HttpCache& cache, const std::string& url, CURL* handle,
+                                                           const std::shared_ptr<const HttpCacheEntry>& cached,
+                                                           const HttpBody& body, bool& revalidated) {
+    long status = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    std::int64_t maxAge = HttpCache::maxAgeSeconds(header(handle, "Cache-Control"));
+    std::int64_t expiresMs = HttpCache::nowMs() + std::max<std::int64_t>(maxAge, 0) * 1000;
+    revalidated = status == 304 && cached;
+    if (revalidated) {
+        cache.countRevalidation();
+        cache.refresh(*cached, expiresMs);
+        return cached;
+    }
+
+    cache.countMiss();
+    std::string etag(header(handle, "ETag"));
+    std::string lastModified(header(handle, "Last-Modified"));
+    if (status == 200 && maxAge >= 0 && (maxAge > 0 || !etag.empty() || !lastModified.empty())) {
+        return cache.store(url, status, body.str(), std::move(etag), std::move(lastModified), expiresMs);
+    }
+    if (status == 200 && cached) {
+        cache.erase(url);
+    }
+    return std::make_shared<HttpCacheEntry>(url, status, body.str(), std::move(etag), std::move(lastModified), 0);
+}
+
+// A new easy handle on the shared caches, with options' timeouts and keep-alive
+inline CURL* createHandle(const HttpClientOptions& options) {
+    CURL* handle = curl_easy_init();
+    if (!handle) {
+        throw std::runtime_error("Could not create curl handle");
+    }
+    curl_easy_setopt(handle, CURLOPT_SHARE, HttpShare::instance().handle());
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, options.keepAliveIdleSeconds);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, options.connectTimeoutMs);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, options.timeoutMs);
+    return handle;
+}
+
+} // namespace http
+
+// A thread-safe HTTP client that pools curl easy handles per host. A handle keeps its
+// connection open between requests, and all handles share DNS and TLS sessions through
+// HttpShare, so repeated calls to a host skip the lookup and handshakes.
+class HttpClient {
+public:
+    explicit HttpClient(const HttpClientOptions& options = HttpClientOptions()) : options_(options) {
+        HttpShare::instance();
+    }
+
+    ~HttpClient() {
+        for (auto& [host, handles] : idle_) {
+            for (CURL* handle : handles) {
+                curl_easy_cleanup(handle);
+            }
+        }
+    }
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    // Fetch url and return the response body, held in a pooled buffer until the HttpBody is
+    // destroyed. Throws std::runtime_error if the transfer fails.
+    HttpBody get(const std::string& url) {
+        http::BodySink sink;
+        Lease lease(*this, url);
+        curl_easy_setopt(lease.handle(), CURLOPT_URL, url.c_str());
+        http::setSink(lease.handle(), &sink, nullptr);
+        CURLcode result = curl_easy_perform(lease.handle());
+        recordMetrics(url, lease.handle(), result);
+        if (result != CURLE_OK) {
+            throw std::runtime_error("Request to " + url + " failed: " + curl_easy_strerror(result));
+        }
+        return std::move(sink.body);
+    }
+
+    // Fetch url, parsing the body as JSON as it arrives rather than buffering it, and return
+    // the HTTP status. If parser's handler stops early the rest of the body is not downloaded.
+    // Throws std::runtime_error if the transfer fails or the body is not valid JSON.
+    long get(const std::string& url, JsonStreamParser& parser) {
+        Lease lease(*this, url);
+        curl_easy_setopt(lease.handle(), CURLOPT_URL, url.c_str());
+        http::setSink(lease.handle(), nullptr, &parser);
+        CURLcode result = curl_easy_perform(lease.handle());
+        recordMetrics(url, lease.handle(), result == CURLE_WRITE_ERROR && parser.stopped() ? CURLE_OK : result);
+        if (parser.failed()) {
+            throw std::runtime_error("Invalid JSON from " + url + ": " + parser.error());
+        }
+        if (result != CURLE_OK && !(result == CURLE_WRITE_ERROR && parser.stopped())) {
+            throw std::runtime_error("Request to " + url + " failed: " + curl_easy_strerror(result));
+        }
+        if (!parser.finish()) {
+            throw std::runtime_error("Invalid JSON from " + url + ": " + parser.error());
+        }
+        long status = 0;
+        curl_easy_getinfo(lease.handle(), CURLINFO_RESPONSE_CODE, &status);
+        return status;
+    }
+
+    // A response from getCached(). entry stays valid while held, even once evicted.
+    struct CachedResponse {
+        enum Source { NETWORK, FRESH, REVALIDATED };
+        std::shared_ptr<const HttpCacheEntry> entry;
+        Source source = NETWORK;
+
+        long status() const { return entry->status(); }
+        std::string_view body() const { return entry->body(); }
+    };
+
+    // Fetch url through options.cache: a fresh entry is returned without a request, a stale
+    // one is revalidated with If-None-Match / If-Modified-Since and returned as is on a 304,
+    // so anything already parsed from it (HttpCacheEntry::parsed) is reused. What is kept is
+    // up to http::cacheResponse. Throws std::runtime_error if the transfer fails or there is
+    // no cache.
+    CachedResponse getCached(const std::string& url) {
+        if (!options_.cache) {
+            throw std::runtime_error("HttpClient::getCached needs HttpClientOptions::cache");
+        }
+        HttpCache& cache = *options_.cache;
+        std::shared_ptr<const HttpCacheEntry> cached = cache.lookup(url);
+        if (cached && cached->fresh(HttpCache::nowMs())) {
+            cache.countHit();
+            return {cached, CachedResponse::FRESH};
+        }
+
+        curl_slist* conditions = http::conditionsFor(cached.get());
+        http::BodySink sink;
+        Lease lease(*this, url);
+        curl_easy_setopt(lease.handle(), CURLOPT_URL, url.c_str());
+        curl_easy_setopt(lease.handle(), CURLOPT_HTTPHEADER, conditions);
+        http::setSink(lease.handle(), &sink, nullptr);
+        CURLcode result = curl_easy_perform(lease.handle());
+        curl_easy_setopt(lease.handle(), CURLOPT_HTTPHEADER, nullptr);
+        curl_slist_free_all(conditions);
+        recordMetrics(url, lease.handle(), result);
+        if (result != CURLE_OK) {
+            throw std::runtime_error("Request to " + url + " failed: " + curl_easy_strerror(result));
+        }
+        bool revalidated = false;
+        std::shared_ptr<const HttpCacheEntry> entry = http::cacheResponse(cache, url, lease.handle(), cached, sink.body, revalidated);
+        return {std::move(entry), revalidated ? CachedResponse::REVALIDATED : CachedResponse::NETWORK};
+    }
+
+    struct Stats {
+        std::uint64_t handlesCreated = 0;
+        std::uint64_t handlesReused = 0;
+    };
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    HttpClientOptions options_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<CURL*>, http::HostHash, std::equal_to<>> idle_;
+    Stats stats_;
+
+    // A handle checked out for one request, returned to the pool afterwards
+    class Lease {
+    public:
+        Lease(HttpClient& client, const std::string& url) : client_(client), host_(http::hostOf(url)), handle_(client.acquire(host_)) {}
+        ~Lease() { client_.release(host_, handle_); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        CURL* handle() const { return handle_; }
+
+    private:
+        HttpClient& client_;
+        std::string_view host_; // points into the request's url
+        CURL* handle_;
+    };
+
+    void recordMetrics(const std::string& url, CURL* handle, CURLcode result) {
+        if (options_.metrics) {
+            options_.metrics->record(url, handle, result);
+        }
+    }
+
+    CURL* acquire(std::string_view host) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = idle_.find(host);
+            if (found != idle_.end() && !found->second.empty()) {
+                CURL* handle = found->second.back();
+                found->second.pop_back();
+                ++stats_.handlesReused;
+                return handle;
+            }
+            ++stats_.handlesCreated;
+        }
+        return http::createHandle(options_);
+    }
+
+    void release(std::string_view host, CURL* handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = idle_.find(host);
+            if (found == idle_.end()) {
+                found = idle_.emplace(std::string(host), std::vector<CURL*>()).first;
+            }
+            auto& handles = found->second;
+            if (handles.size() < options_.maxIdlePerHost) {
+                handles.push_back(handle);
+                return;
+            }
+        }
+        curl_easy_cleanup(handle);
+    }
+};
+
+// Outcome of an AsyncHttpClient request
+struct HttpResult {
+    CURLcode code = CURLE_OK;
+    long status = 0;      // HTTP status, 0 if no response arrived
+    double seconds = 0;   // transfer time, not counting time spent queued
+    HttpBody body;        // pooled; empty for streamed JSON requests
+    std::string error;    // set when code is not CURLE_OK
+    std::string jsonError; // streamed JSON requests: why the body is not valid JSON
+    long retryAfterSeconds = 0; // the response's Retry-After, e.g. on a 429; 0 if none
+    // getCached requests: the response, kept in the cache when it may be, in place of body.
+    // Null if the transfer failed.
+    std::shared_ptr<const HttpCacheEntry> entry;
+    bool fromCache = false; // served fresh or confirmed by a 304, without downloading the body
+
+    bool ok() const { return code == CURLE_OK; }
+};
+
+struct AsyncHttpOptions {
+    HttpClientOptions http;
+    std::size_t maxPerHost = 8;     // transfers in flight per scheme://host:port; the rest wait their turn
+    std::size_t maxInFlight = 1024; // transfers in flight overall
+};
+
+// Runs many HTTP requests concurrently on a single event-loop thread: a curl multi handle
+// driven through its socket interface by epoll (curl_multi_poll where epoll is missing).
+// Requests queue per host and start as that host's and the overall limits allow. Easy handles
+// are pooled per host and share HttpShare's caches like HttpClient's; open connections are
+// kept in the multi handle's own cache.
+class AsyncHttpClient {
+public:
+    // Runs on the event-loop thread, so it should hand off anything slow
+    using Callback = std::function<void(HttpResult&&)>;
+
+    explicit AsyncHttpClient(const AsyncHttpOptions& options = AsyncHttpOptions()) : options_(options) {
+        HttpShare::instance();
+        multi_ = curl_multi_init();
+        if (!multi_) {
+            throw std::runtime_error("Could not create curl multi handle");
+        }
+#ifdef __linux__
+        epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd_ < 0 || wakeFd_ < 0) {
+            throw std::runtime_error("Could not set up the HTTP event loop");
+        }
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wakeFd_;
+        ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &AsyncHttpClient::onSocket);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &AsyncHttpClient::onTimer);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+#endif
+        // Room to keep every in-flight transfer's connection open once it finishes. A smaller
+        // cache closes one whenever a transfer ends, and a busy host reconnects every time.
+        curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, static_cast<long>(options_.maxInFlight));
+        loop_ = std::thread(&AsyncHttpClient::run, this);
+    }
+
+    // Requests still queued or in flight complete with CURLE_ABORTED_BY_CALLBACK
+    ~AsyncHttpClient() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake();
+        loop_.join();
+        for (auto& [host, state] : hosts_) {
+            for (CURL* handle : state.idle) {
+                curl_easy_cleanup(handle);
+            }
+        }
+        curl_multi_cleanup(multi_);
+#ifdef __linux__
+        ::close(wakeFd_);
+        ::close(epollFd_);
+#endif
+    }
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    // Queue a GET of url; callback receives the result on the event-loop thread
+    void get(const std::string& url, Callback callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                throw std::runtime_error("AsyncHttpClient is shutting down");
+            }
+            incoming_.emplace_back(url, std::move(callback));
+        }
+        wake();
+    }
+
+    // Queue a GET of url whose body is parsed by parser as it arrives instead of being kept.
+    // parser and its handler are used on the event-loop thread until callback runs.
+    void get(const std::string& url, std::shared_ptr<JsonStreamParser> parser, Callback callback) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                throw std::runtime_error("AsyncHttpClient is shutting down");
+            }
+            incoming_.emplace_back(url, std::move(callback), std::move(parser));
+        }
+        wake();
+    }
+
+    // Queue a GET of url through options.http.cache, like HttpClient::getCached: a fresh entry
+    // completes at once without a request, a stale one is revalidated, and callback gets the
+    // entry in result.entry. Throws std::runtime_error if there is no cache.
+    void getCached(const std::string& url, Callback callback) {
+        if (!options_.http.cache) {
+            throw std::runtime_error("AsyncHttpClient::getCached needs HttpClientOptions::cache");
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                throw std::runtime_error("AsyncHttpClient is shutting down");
+            }
+            incoming_.emplace_back(url, std::move(callback), nullptr, true);
+        }
+        wake();
+    }
+
+    std::future<HttpResult> get(const std::string& url) {
+        auto promise = std::make_shared<std::promise<HttpResult>>();
+        std::future<HttpResult> result = promise->get_future();
+        get(url, [promise](HttpResult&& outcome) { promise->set_value(std::move(outcome)); });
+        return result;
+    }
+
+private:
+    struct Request {
+        Request() = default;
+        Request(const std::string& url, Callback callback, std::shared_ptr<JsonStreamParser> parser = nullptr,
+                bool cached = false)
+            : url(url), host(http::hostKey(url)), callback(std::move(callback)), parser(std::move(parser)), cached(cached) {}
+
+        std::string url;
+        std::string host;
+        Callback callback;
+        std::shared_ptr<JsonStreamParser> parser;
+        bool cached = false;                        // through options_.http.cache
+        std::shared_ptr<const HttpCacheEntry> stale; // the cached entry to revalidate, if any
+    };
+
+    struct Transfer {
+        Request request;
+        CURL* handle = nullptr;
+        http::BodySink sink;
+        curl_slist* conditions = nullptr; // revalidation headers
+    };
+
+    struct HostState {
+        std::deque<Request> queued;
+        std::size_t active = 0;
+        std::vector<CURL*> idle;
+        bool backlogged = false; // listed in backlog_
+    };
+
+    AsyncHttpOptions options_;
+    CURLM* multi_ = nullptr;
+    std::thread loop_;
+
+    std::mutex mutex_; // guards incoming_ and stopping_; everything else is the loop thread's
+    std::vector<Request> incoming_;
+    bool stopping_ = false;
+
+    std::unordered_map<std::string, HostState> hosts_;
+    std::unordered_set<CURL*> active_;
+    std::size_t inFlight_ = 0;
+    std::size_t waiting_ = 0; // queued in hosts_
+    std::vector<HostState*> backlog_; // hosts with queued requests; hosts_ never drops an entry
+
+#ifdef __linux__
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::chrono::steady_clock::time_point deadline_ = std::chrono::steady_clock::time_point::max();
+
+    static int onSocket(CURL*, curl_socket_t socket, int what, void* userp, void* socketp) {
+        auto* client = static_cast<AsyncHttpClient*>(userp);
+        if (what == CURL_POLL_REMOVE) {
+            ::epoll_ctl(client->epollFd_, EPOLL_CTL_DEL, socket, nullptr);
+            return 0;
+        }
+        epoll_event event{};
+        event.events = ((what & CURL_POLL_IN) ? EPOLLIN : 0u) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0u);
+        event.data.fd = socket;
+        if (!socketp) {
+            // Mark the socket as registered so the next change is a modification
+            curl_multi_assign(client->multi_, socket, client);
+            if (::epoll_ctl(client->epollFd_, EPOLL_CTL_ADD, socket, &event) == 0 || errno != EEXIST) {
+                return 0;
+            }
+        }
+        ::epoll_ctl(client->epollFd_, EPOLL_CTL_MOD, socket, &event);
+        return 0;
+    }
+
+    static int onTimer(CURLM*, long timeoutMs, void* userp) {
+        auto* client = static_cast<AsyncHttpClient*>(userp);
+        client->deadline_ = timeoutMs < 0 ? std::chrono::steady_clock::time_point::max()
+                                          : std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        return 0;
+    }
+#endif
+
+    void wake() {
+#ifdef __linux__
+        std::uint64_t one = 1;
+        ssize_t written = ::write(wakeFd_, &one, sizeof(one));
+        (void)written; // a full counter is still a pending wakeup
+#else
+        curl_multi_wakeup(multi_);
+#endif
+    }
+
+    void run() {
+        int running = 0;
+        for (;;) {
+            bool stopping = admitIncoming();
+            if (stopping) {
+                abortAll();
+                return;
+            }
+#ifdef __linux__
+            constexpr int kMaxEvents = 256;
+            epoll_event events[kMaxEvents];
+            int waitMs = -1;
+            if (deadline_ != std::chrono::steady_clock::time_point::max()) {
+                auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline_ - std::chrono::steady_clock::now());
+                waitMs = static_cast<int>(std::clamp<std::int64_t>(remaining.count(), 0, 60000));
+            }
+            int count = ::epoll_wait(epollFd_, events, kMaxEvents, waitMs);
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wakeFd_) {
+                    std::uint64_t value;
+                    ssize_t drained = ::read(wakeFd_, &value, sizeof(value));
+                    (void)drained;
+                    continue;
+                }
+                int flags = ((events[i].events & EPOLLIN) ? CURL_CSELECT_IN : 0) |
+                            ((events[i].events & EPOLLOUT) ? CURL_CSELECT_OUT : 0) |
+                            ((events[i].events & (EPOLLERR | EPOLLHUP)) ? CURL_CSELECT_ERR : 0);
+                curl_multi_socket_action(multi_, fd, flags, &running);
+            }
+            if (std::chrono::steady_clock::now() >= deadline_) {
+                deadline_ = std::chrono::steady_clock::time_point::max();
+                curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+            }
+#else
+            curl_multi_perform(multi_, &running);
+            curl_multi_poll(multi_, nullptr, 0, 1000, nullptr);
+            curl_multi_perform(multi_, &running);
+#endif
+            finishCompleted();
+        }
+    }
+
+    // Move newly submitted requests into their host queues and start what the limits allow.
+    // Returns whether the client is stopping.
+    bool admitIncoming() {
+        std::vector<Request> incoming;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return true;
+            }
+            incoming.swap(incoming_);
+        }
+        for (auto& request : incoming) {
+            if (request.cached) {
+                HttpCache& cache = *options_.http.cache;
+                request.stale = cache.lookup(request.url);
+                if (request.stale && request.stale->fresh(HttpCache::nowMs())) {
+                    cache.countHit();
+                    HttpResult result;
+                    result.status = request.stale->status();
+                    result.entry = std::move(request.stale);
+                    result.fromCache = true;
+                    deliver(request, std::move(result));
+                    continue;
+                }
+            }
+            HostState& host = hosts_[request.host];
+            host.queued.push_back(std::move(request));
+            ++waiting_;
+            startQueued(host);
+            if (!host.queued.empty() && !host.backlogged) {
+                host.backlogged = true;
+                backlog_.push_back(&host);
+            }
+        }
+        return false;
+    }
+
+    void startQueued(HostState& host) {
+        while (!host.queued.empty() && host.active < options_.maxPerHost && inFlight_ < options_.maxInFlight) {
+            auto transfer = std::make_unique<Transfer>();
+            transfer->request = std::move(host.queued.front());
+            host.queued.pop_front();
+            --waiting_;
+            if (!host.idle.empty()) {
+                transfer->handle = host.idle.back();
+                host.idle.pop_back();
+            } else {
+                try {
+                    transfer->handle = http::createHandle(options_.http);
+                } catch (const std::exception& e) {
+                    HttpResult result;
+                    result.code = CURLE_FAILED_INIT;
+                    result.error = e.what();
+                    deliver(transfer->request, std::move(result));
+                    continue;
+                }
+            }
+            curl_easy_setopt(transfer->handle, CURLOPT_URL, transfer->request.url.c_str());
+            transfer->conditions = http::conditionsFor(transfer->request.stale.get());
+            curl_easy_setopt(transfer->handle, CURLOPT_HTTPHEADER, transfer->conditions);
+            http::setSink(transfer->handle, &transfer->sink, transfer->request.parser.get());
+            curl_easy_setopt(transfer->handle, CURLOPT_PRIVATE, transfer.get());
+            curl_multi_add_handle(multi_, transfer->handle);
+            active_.insert(transfer->handle);
+            transfer.release(); // owned through CURLOPT_PRIVATE until it completes
+            ++host.active;
+            ++inFlight_;
+        }
+    }
+
+    void finishCompleted() {
+        int remaining = 0;
+        bool finished = false;
+        while (CURLMsg* message = curl_multi_info_read(multi_, &remaining)) {
+            if (message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            HttpResult result;
+            result.code = message->data.result;
+            // A streamed request whose handler stopped it early succeeded, in the metrics too
+            const Request& request = transferOf(message->easy_handle).request;
+            if (result.code == CURLE_WRITE_ERROR && request.parser && request.parser->stopped()) {
+                result.code = CURLE_OK; // the handler had what it needed
+            }
+            if (HttpMetrics* metrics = options_.http.metrics) {
+                metrics->record(request.url, message->easy_handle, result.code);
+            }
+            std::unique_ptr<Transfer> transfer = release(message->easy_handle, result);
+            deliver(transfer->request, std::move(result));
+            finished = true;
+        }
+        // Freed slots go to the hosts still waiting
+        if (finished && waiting_ > 0) {
+            for (std::size_t i = 0; i < backlog_.size();) {
+                HostState& host = *backlog_[i];
+                startQueued(host);
+                if (host.queued.empty()) {
+                    host.backlogged = false;
+                    backlog_[i] = backlog_.back();
+                    backlog_.pop_back();
+                } else {
+                    ++i;
+                }
+            }
+        }
+    }
+
+    static const Transfer& transferOf(CURL* handle) {
+        char* privateData = nullptr;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, &privateData);
+        return *reinterpret_cast<Transfer*>(privateData);
+    }
+
+    // Take a finished transfer off the multi handle, fill in result and pool its handle
+    std::unique_ptr<Transfer> release(CURL* handle, HttpResult& result) {
+        char* privateData = nullptr;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, &privateData);
+        std::unique_ptr<Transfer> transfer(reinterpret_cast<Transfer*>(privateData));
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &result.status);
+        curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &result.seconds);
+        curl_off_t retryAfter = 0;
+        if (curl_easy_getinfo(handle, CURLINFO_RETRY_AFTER, &retryAfter) == CURLE_OK) {
+            result.retryAfterSeconds = static_cast<long>(retryAfter);
+        }
+        if (JsonStreamParser* parser = transfer->request.parser.get()) {
+            if (parser->failed() || (result.code == CURLE_OK && !parser->finish())) {
+                result.jsonError = parser->error();
+            }
+        }
+        if (result.code != CURLE_OK && result.error.empty()) {
+            result.error = curl_easy_strerror(result.code);
+        }
+        if (!transfer->request.cached) {
+            result.body = std::move(transfer->sink.body);
+        } else if (result.code == CURLE_OK) {
+            result.entry = http::cacheResponse(*options_.http.cache, transfer->request.url, handle, transfer->request.stale,
+                                               transfer->sink.body, result.fromCache);
+        }
+        curl_multi_remove_handle(multi_, handle);
+        active_.erase(handle);
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, nullptr);
+        curl_slist_free_all(transfer->conditions);
+        transfer->conditions = nullptr;
+
+        HostState& host = hosts_[transfer->request.host];
+        --host.active;
+        --inFlight_;
+        if (host.idle.size() < options_.http.maxIdlePerHost) {
+            host.idle.push_back(handle);
+        } else {
+            curl_easy_cleanup(handle);
+        }
+        return transfer;
+    }
+
+    static void deliver(Request& request, HttpResult&& result) {
+        try {
+            request.callback(std::move(result));
+        } catch (const std::exception& e) {
+            std::cerr << "HTTP callback for " << request.url << " threw: " << e.what() << std::endl;
+        }
+    }
+
+    void abortAll() {
+        auto aborted = []() {
+            HttpResult result;
+            result.code = CURLE_ABORTED_BY_CALLBACK;
+            result.error = "HTTP client shut down";
+            return result;
+        };
+        std::vector<CURL*> active(active_.begin(), active_.end());
+        for (CURL* handle : active) {
+            HttpResult result = aborted();
+            std::unique_ptr<Transfer> transfer = release(handle, result);
+            deliver(transfer->request, std::move(result));
+        }
+        for (HostState* host : backlog_) {
+            for (auto& request : host->queued) {
+                deliver(request, aborted());
+            }
+            host->queued.clear();
+            host->backlogged = false;
+        }
+        backlog_.clear();
+        // Callbacks run without mutex_, so one that submits another request fails cleanly
+        // instead of deadlocking
+        std::vector<Request> incoming;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            incoming.swap(incoming_);
+        }
+        for (auto& request : incoming) {
+            deliver(request, aborted());
+        }
+    }
+};
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+#include "HttpClient.h"
+#include "MockHttpServer.h"
+#include "BenchmarkSupport.h"
+
+// Requests/s, latency percentiles and connection reuse of HttpClient and AsyncHttpClient, and
+// ingest rate of chunked streams, all against a MockHttpServer on the loopback interface.
+// Results go to stdout as CSV (or JSON lines with --json), one row per run; progress goes to stderr.
+
+enum class HttpBenchMode {
+    SYNC,   // HttpClient::get from `concurrency` threads sharing one client
+    ASYNC,  // AsyncHttpClient with `concurrency` transfers in flight
+    STREAM  // `concurrency` streams at once, read the way TwitterStreamClient reads them
+};
+
+struct HttpBenchOptions {
+    std::vector<int> concurrency = {1, 4, 16, 64};
+    std::vector<std::size_t> sizes = {256, 4096, 65536};  // response bodies; per stream for STREAM
+    std::vector<HttpBenchMode> modes = {HttpBenchMode::SYNC, HttpBenchMode::ASYNC, HttpBenchMode::STREAM};
+    std::uint64_t requests = 20000;                       // per run, split across the threads
+    std::size_t streamBytes = 64u << 20;                  // per stream
+    std::chrono::microseconds latency{0};
+    double errorRate = 0;
+    bool json = false;
+};
+
+struct HttpBenchResult {
+    HttpBenchMode mode;
+    int concurrency;
+    std::size_t bodyBytes;
+    std::uint64_t requests;
+    double seconds;
+    std::uint64_t bytes;     // response bytes the client received
+    std::uint64_t messages;  // STREAM: tweets received
+    std::int64_t p50;        // per request; per whole stream for STREAM
+    std::int64_t p99;
+    std::int64_t p999;
+    std::int64_t max;
+    MockHttpServer::Stats server;
+};
+
+const char* modeToString(HttpBenchMode mode) {
+    switch (mode) {
+        case HttpBenchMode::SYNC: return "sync";
+        case HttpBenchMode::ASYNC: return "async";
+        case HttpBenchMode::STREAM: return "stream";
+    }
+    return "unknown";
+}
+
+// Counts what a stream delivers; tweets end in \r\n, keep-alive newlines do not
+struct StreamCounter {
+    std::uint64_t bytes = 0;
+    std::uint64_t messages = 0;
+
+    static size_t write(char* data, size_t size, size_t count, void* userp) {
+        auto* counter = static_cast<StreamCounter*>(userp);
+        std::size_t length = size * count;
+        counter->bytes += length;
+        for (const char* at = data; (at = static_cast<const char*>(std::memchr(at, '\r', length - (at - data)))); ++at) {
+            ++counter->messages;
+        }
+        return length;
+    }
+};
+
+HttpBenchResult runHttpBench(const HttpBenchOptions& options, HttpBenchMode mode, int concurrency, std::size_t bodyBytes) {
+    using Clock = std::chrono::steady_clock;
+
+    MockHttpOptions serverOptions;
+    serverOptions.latency = options.latency;
+    serverOptions.errorRate = options.errorRate;
+    serverOptions.payloadBytes = bodyBytes;
+    serverOptions.streamBytes = bodyBytes;
+    MockHttpServer server(serverOptions);
+    std::string url = server.baseUrl() + "/1.1/statuses/show.json";
+    std::string streamUrl = server.baseUrl() + "/1.1/statuses/filter.json?track=example";
+
+    // Every thread makes at least one request, so a run never ends up empty
+    std::uint64_t perThread = mode == HttpBenchMode::STREAM ? 1
+        : std::max<std::uint64_t>(1, options.requests / static_cast<std::uint64_t>(concurrency));
+    std::vector<LatencyRecorder> latencies(concurrency);
+    for (auto& latency : latencies) {
+        latency.reserve(perThread);
+    }
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> messages{0};
+
+    Clock::time_point start;
+    Clock::time_point finished;
+    if (mode == HttpBenchMode::ASYNC) {
+        AsyncHttpOptions clientOptions;
+        clientOptions.maxPerHost = static_cast<std::size_t>(concurrency);
+        clientOptions.http.maxIdlePerHost = static_cast<std::size_t>(concurrency);
+        AsyncHttpClient client(clientOptions);
+        client.get(url).get(); // connect once outside the timed run
+
+        std::uint64_t total = perThread * static_cast<std::uint64_t>(concurrency);
+        std::atomic<std::uint64_t> remaining{total};
+        std::promise<void> done;
+        if (total == 0) {
+            done.set_value();
+        }
+        LatencyRecorder& latency = latencies[0];
+        latency.reserve(total);
+        start = Clock::now();
+        for (std::uint64_t i = 0; i < total; ++i) {
+            client.get(url, [&](HttpResult&& result) {
+                // Callbacks all run on the event-loop thread
+                latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(result.seconds)));
+                bytes.fetch_add(result.body.size(), std::memory_order_relaxed);
+                if (remaining.fetch_sub(1) == 1) {
+                    done.set_value();
+                }
+            });
+        }
+        done.get_future().wait();
+        finished = Clock::now();
+    } else {
+        HttpClientOptions clientOptions;
+        clientOptions.maxIdlePerHost = static_cast<std::size_t>(concurrency);
+        HttpClient client(clientOptions);
+
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<std::thread> workers;
+        for (int t = 0; t < concurrency; ++t) {
+            workers.emplace_back([&, t]() {
+                if (mode == HttpBenchMode::SYNC) {
+                    client.get(url); // connect once outside the timed run
+                }
+                ready.fetch_add(1);
+                while (!go.load()) {
+                    std::this_thread::yield();
+                }
+                LatencyRecorder& latency = latencies[t];
+                for (std::uint64_t i = 0; i < perThread; ++i) {
+                    auto requestStart = Clock::now();
+                    if (mode == HttpBenchMode::SYNC) {
+                        bytes.fetch_add(client.get(url).size(), std::memory_order_relaxed);
+                    } else {
+                        StreamCounter counter;
+                        CURL* curl = curl_easy_init();
+                        curl_easy_setopt(curl, CURLOPT_URL, streamUrl.c_str());
+                        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+                        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCounter::write);
+                        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &counter);
+                        CURLcode result = curl_easy_perform(curl);
+                        curl_easy_cleanup(curl);
+                        if (result != CURLE_OK) {
+                            std::cerr << "Stream failed: " << curl_easy_strerror(result) << std::endl;
+                        }
+                        bytes.fetch_add(counter.bytes, std::memory_order_relaxed);
+                        messages.fetch_add(counter.messages, std::memory_order_relaxed);
+                    }
+                    latency.record(Clock::now() - requestStart);
+                }
+            });
+        }
+        while (ready.load() < concurrency) {
+            std::this_thread::yield();
+        }
+        start = Clock::now();
+        go.store(true);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        finished = Clock::now();
+    }
+
+    LatencyRecorder merged;
+    for (const auto& latency : latencies) {
+        merged.merge(latency);
+    }
+
+    HttpBenchResult result{};
+    result.mode = mode;
+    result.concurrency = concurrency;
+    result.bodyBytes = bodyBytes;
+    result.requests = merged.count();
+    result.seconds = std::chrono::duration<double>(finished - start).count();
+    result.bytes = bytes.load();
+    result.messages = messages.load();
+    result.p50 = merged.percentile(0.50);
+    result.p99 = merged.percentile(0.99);
+    result.p999 = merged.percentile(0.999);
+    result.max = merged.percentile(1.0);
+    result.server = server.stats();
+    return result;
+}
+
+void printResult(const HttpBenchResult& result, const HttpBenchOptions& options, std::ostream& out) {
+    double requestsPerSecond = static_cast<double>(result.requests) / result.seconds;
+    double megabytesPerSecond = static_cast<double>(result.bytes) / result.seconds / 1e6;
+    double requestsPerConnection = result.server.connections == 0 ? 0.0
+        : static_cast<double>(result.server.requests) / static_cast<double>(result.server.connections);
+    out << std::fixed;
+    if (options.json) {
+        out << "{\"mode\":\"" << modeToString(result.mode) << "\",\"concurrency\":" << result.concurrency
+            << ",\"body_bytes\":" << result.bodyBytes << ",\"requests\":" << result.requests
+            << std::setprecision(6) << ",\"seconds\":" << result.seconds
+            << std::setprecision(0) << ",\"requests_per_sec\":" << requestsPerSecond
+            << std::setprecision(2) << ",\"mb_per_sec\":" << megabytesPerSecond
+            << ",\"messages\":" << result.messages
+            << ",\"p50_us\":" << result.p50 / 1000 << ",\"p99_us\":" << result.p99 / 1000
+            << ",\"p999_us\":" << result.p999 / 1000 << ",\"max_us\":" << result.max / 1000
+            << ",\"errors\":" << result.server.errors << ",\"connections\":" << result.server.connections
+            << ",\"requests_per_connection\":" << requestsPerConnection << "}\n";
+    } else {
+        out << modeToString(result.mode) << ',' << result.concurrency << ',' << result.bodyBytes << ','
+            << result.requests << ',' << std::setprecision(6) << result.seconds << ','
+            << std::setprecision(0) << requestsPerSecond << ',' << std::setprecision(2) << megabytesPerSecond << ','
+            << result.messages << ',' << result.p50 / 1000 << ',' << result.p99 / 1000 << ','
+            << result.p999 / 1000 << ',' << result.max / 1000 << ',' << result.server.errors << ','
+            << result.server.connections << ',' << requestsPerConnection << '\n';
+    }
+    out << std::flush;
+}
+
+template<typename T>
+std::vector<T> parseList(const std::string& text) {
+    std::vector<T> values;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(static_cast<T>(std::stoull(item)));
+    }
+    if (values.empty()) {
+        throw std::invalid_argument("Empty list: " + text);
+    }
+    return values;
+}
+
+void printUsage() {
+    std::cerr << "Usage: HttpClientBench [--concurrency 1,4,...] [--sizes 256,4096,...] [--modes sync,async,stream]\n"
+              << "                       [--requests N] [--stream-bytes N] [--latency-us N] [--error-rate F] [--json]\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        HttpBenchOptions options;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--concurrency" && hasValue) {
+                options.concurrency = parseList<int>(argv[++i]);
+            } else if (arg == "--sizes" && hasValue) {
+                options.sizes = parseList<std::size_t>(argv[++i]);
+            } else if (arg == "--modes" && hasValue) {
+                std::istringstream modes(argv[++i]);
+                std::string mode;
+                options.modes.clear();
+                while (std::getline(modes, mode, ',')) {
+                    if (mode == "sync") {
+                        options.modes.push_back(HttpBenchMode::SYNC);
+                    } else if (mode == "async") {
+                        options.modes.push_back(HttpBenchMode::ASYNC);
+                    } else if (mode == "stream") {
+                        options.modes.push_back(HttpBenchMode::STREAM);
+                    } else {
+                        throw std::invalid_argument("Unknown mode " + mode);
+                    }
+                }
+            } else if (arg == "--requests" && hasValue) {
+                options.requests = std::stoull(argv[++i]);
+            } else if (arg == "--stream-bytes" && hasValue) {
+                options.streamBytes = std::stoull(argv[++i]);
+            } else if (arg == "--latency-us" && hasValue) {
+                options.latency = std::chrono::microseconds(std::stoll(argv[++i]));
+            } else if (arg == "--error-rate" && hasValue) {
+                options.errorRate = std::stod(argv[++i]);
+            } else if (arg == "--json") {
+                options.json = true;
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+        if (options.modes.empty()) {
+            throw std::invalid_argument("No modes selected");
+        }
+        for (int concurrency : options.concurrency) {
+            if (concurrency < 1) {
+                throw std::invalid_argument("Concurrency must be at least 1");
+            }
+        }
+
+        std::ios::sync_with_stdio(false);
+        if (!options.json) {
+            std::cout << "mode,concurrency,body_bytes,requests,seconds,requests_per_sec,mb_per_sec,messages,"
+                         "p50_us,p99_us,p999_us,max_us,errors,connections,requests_per_connection\n";
+        }
+        for (HttpBenchMode mode : options.modes) {
+            for (int concurrency : options.concurrency) {
+                // Streams are sized by --stream-bytes rather than --sizes
+                std::vector<std::size_t> sizes = mode == HttpBenchMode::STREAM ? std::vector<std::size_t>{options.streamBytes} : options.sizes;
+                for (std::size_t size : sizes) {
+                    std::cerr << modeToString(mode) << ' ' << concurrency << " concurrent, " << size << " B bodies..." << std::endl;
+                    printResult(runHttpBench(options, mode, concurrency, size), options, std::cout);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <curl/curl.h>
+
+// A high-dynamic-range histogram of microsecond latencies: exact below 128 us, then 64
+// sub-buckets per power of two (under 1.6% error) up to ~38 hours. Counts are relaxed atomics,
+// so any number of threads record without locks while another reads percentiles.
+class HdrHistogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    static constexpr std::uint64_t kSubBuckets = 1u << kSubBucketBits;  // exact range
+    static constexpr std::uint64_t kHalfBuckets = kSubBuckets / 2;
+    static constexpr int kMaxMagnitude = 30;                             // values up to 2^37-1 us
+    static constexpr std::size_t kBuckets = kSubBuckets + kMaxMagnitude * kHalfBuckets;
+    static constexpr std::uint64_t kMaxValue = (kSubBuckets << kMaxMagnitude) - 1;
+
+    void record(std::uint64_t micros) {
+        counts_[indexOf(std::min(micros, kMaxValue))].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+    std::uint64_t sumMicros() const { return sum_.load(std::memory_order_relaxed); }
+
+    // The value at quantile q (0..1), as the highest value of its bucket; 0 when empty
+    std::uint64_t percentile(double q) const {
+        std::uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(total) + 0.5);
+        rank = std::clamp<std::uint64_t>(rank, 1, total);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return highestValueOf(i);
+            }
+        }
+        // Counts raced ahead of total_; the last bucket with anything in it is the answer
+        for (std::size_t i = kBuckets; i-- > 0;) {
+            if (counts_[i].load(std::memory_order_relaxed) != 0) {
+                return highestValueOf(i);
+            }
+        }
+        return 0;
+    }
+
+    static std::size_t indexOf(std::uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<std::size_t>(value);
+        }
+        int magnitude = (63 - __builtin_clzll(value)) - (kSubBucketBits - 1);
+        std::uint64_t sub = value >> magnitude; // kHalfBuckets..kSubBuckets-1
+        return static_cast<std::size_t>(kSubBuckets + (magnitude - 1) * kHalfBuckets + (sub - kHalfBuckets));
+    }
+
+    static std::uint64_t highestValueOf(std::size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        std::size_t magnitude = (index - kSubBuckets) / kHalfBuckets + 1;
+        std::uint64_t sub = (index - kSubBuckets) % kHalfBuckets + kHalfBuckets;
+        return ((sub + 1) << magnitude) - 1;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> counts_{};
+    std::atomic<std::uint64_t> total_{0};
+    std::atomic<std::uint64_t> sum_{0};
+};
+
+// Per-endpoint latency histograms for outbound HTTP calls, filled from curl's timing info.
+// An endpoint is the URL without its query string. Recording takes a shared lock to find the
+// endpoint (exclusive only the first time an endpoint is seen) and then only atomic adds.
+class HttpMetrics {
+public:
+    enum Phase { DNS, CONNECT, TLS, TTFB, TOTAL, PHASE_COUNT };
+
+    static constexpr const char* phaseName(Phase phase) {
+        constexpr const char* names[] = {"dns", "connect", "tls", "ttfb", "total"};
+        return names[phase];
+    }
+
+    // Record a finished transfer on handle. dns, connect and tls are only recorded when the
+    // transfer opened a new connection, so reused connections do not drag them towards zero.
+    void record(std::string_view url, CURL* handle, CURLcode code) {
+        Endpoint& endpoint = endpointFor(url);
+        if (code != CURLE_OK) {
+            endpoint.failures.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        curl_off_t lookup = 0, connect = 0, appConnect = 0, firstByte = 0, total = 0;
+        long connects = 0;
+        curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+        curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+        curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+        curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+        if (connects > 0) {
+            endpoint.phases[DNS].record(micros(lookup));
+            endpoint.phases[CONNECT].record(micros(connect - lookup));
+            if (appConnect > 0) {
+                endpoint.phases[TLS].record(micros(appConnect - connect));
+            }
+        }
+        endpoint.phases[TTFB].record(micros(firstByte));
+        endpoint.phases[TOTAL].record(micros(total));
+    }
+
+    // Everything recorded so far in Prometheus text exposition format: a summary per phase
+    // labelled with endpoint and phase, plus a failure counter per endpoint
+    std::string prometheusText() const {
+        static constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+        std::ostringstream out;
+        out << "# HELP http_client_request_seconds Outbound HTTP request latency by phase.\n"
+            << "# TYPE http_client_request_seconds summary\n";
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& [name, endpoint] : endpoints_) {
+            std::string label = escapeLabel(name);
+            for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+                const HdrHistogram& histogram = endpoint->phases[phase];
+                if (histogram.count() == 0) {
+                    continue;
+                }
+                std::string labels = "endpoint=\"" + label + "\",phase=\"" + phaseName(static_cast<Phase>(phase)) + "\"";
+                for (double q : kQuantiles) {
+                    out << "http_client_request_seconds{" << labels << ",quantile=\"" << q << "\"} "
+                        << seconds(histogram.percentile(q)) << '\n';
+                }
+                out << "http_client_request_seconds_sum{" << labels << "} " << seconds(histogram.sumMicros()) << '\n'
+                    << "http_client_request_seconds_count{" << labels << "} " << histogram.count() << '\n';
+            }
+        }
+        out << "# HELP http_client_failures_total Outbound HTTP requests that failed before a response.\n"
+            << "# TYPE http_client_failures_total counter\n";
+        for (const auto& [name, endpoint] : endpoints_) {
+            out << "http_client_failures_total{endpoint=\"" << escapeLabel(name) << "\"} "
+                << endpoint->failures.load(std::memory_order_relaxed) << '\n';
+        }
+        return out.str();
+    }
+
+    // Write prometheusText() to path through a temporary file, so readers never see half of it
+    void dump(const std::string& path) const {
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("Could not write metrics to " + temporary);
+            }
+            file << prometheusText();
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Could not replace " + path);
+        }
+    }
+
+private:
+    struct Endpoint {
+        std::array<HdrHistogram, PHASE_COUNT> phases;
+        std::atomic<std::uint64_t> failures{0};
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::map<std::string, std::unique_ptr<Endpoint>, std::less<>> endpoints_;
+
+    Endpoint& endpointFor(std::string_view url) {
+        std::string_view name = url.substr(0, url.find_first_of("?#"));
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto found = endpoints_.find(name);
+            if (found != endpoints_.end()) {
+                return *found->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto& endpoint = endpoints_[std::string(name)];
+        if (!endpoint) {
+            endpoint = std::make_unique<Endpoint>();
+        }
+        return *endpoint;
+    }
+
+    static std::uint64_t micros(curl_off_t value) {
+        return value > 0 ? static_cast<std::uint64_t>(value) : 0;
+    }
+
+    static double seconds(std::uint64_t micros) {
+        return static_cast<double>(micros) / 1e6;
+    }
+
+    static std::string escapeLabel(std::string_view value) {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+};
+
+// Serves HttpMetrics::prometheusText() to any GET on 127.0.0.1:port from a background thread,
+// for a Prometheus scraper or curl. Port 0 picks a free port; see port().
+class MetricsServer {
+public:
+    MetricsServer(const HttpMetrics& metrics, int port) : metrics_(metrics) {
+        listenFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0) {
+            throw std::runtime_error("Could not create metrics socket");
+        }
+        int reuse = 1;
+        ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(port));
+        socklen_t length = sizeof(address);
+        if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd_, 16) != 0 ||
+            ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            ::close(listenFd_);
+            throw std::runtime_error("Could not listen for metrics on port " + std::to_string(port));
+        }
+        port_ = ntohs(address.sin_port);
+        thread_ = std::thread(&MetricsServer::serve, this);
+    }
+
+    ~MetricsServer() {
+        stop_.store(true);
+        thread_.join();
+        ::close(listenFd_);
+    }
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    int port() const { return port_; }
+
+private:
+    const HttpMetrics& metrics_;
+    int listenFd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+
+    void serve() {
+        while (!stop_.load()) {
+            pollfd listening{listenFd_, POLLIN, 0};
+            if (::poll(&listening, 1, 200) <= 0) {
+                continue;
+            }
+            int client = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                continue;
+            }
+            respond(client);
+            ::close(client);
+        }
+    }
+
+    // One request per connection; the request itself only needs to arrive
+    void respond(int client) {
+        char request[1024];
+        pollfd readable{client, POLLIN, 0};
+        if (::poll(&readable, 1, 1000) <= 0 || ::recv(client, request, sizeof(request), 0) <= 0) {
+            return;
+        }
+        std::string body = metrics_.prometheusText();
+        std::string response = "HTTP/1.1 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        std::size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t written = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                return;
+            }
+            sent += static_cast<std::size_t>(written);
+        }
+    }
+};
+
+// Dumps HttpMetrics to a file every interval from a background thread, and once more when
+// destroyed, so the file always holds the final numbers
+class MetricsDumper {
+public:
+    MetricsDumper(const HttpMetrics& metrics, std::string path, std::chrono::milliseconds interval)
+        : metrics_(metrics), path_(std::move(path)), interval_(interval), thread_(&MetricsDumper::run, this) {}
+
+    ~MetricsDumper() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    MetricsDumper(const MetricsDumper&) = delete;
+    MetricsDumper& operator=(const MetricsDumper&) = delete;
+
+private:
+    const HttpMetrics& metrics_;
+    std::string path_;
+    std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+    std::thread thread_;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            bool stopping = cv_.wait_for(lock, interval_, [this]() { return stop_; });
+            try {
+                metrics_.dump(path_);
+            } catch (const std::exception& e) {
+                std::cerr << "Metrics dump failed: " << e.what() << std::endl;
+            }
+            if (stopping) {
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,545 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Incremental, SAX-style JSON parsing for bodies that arrive in chunks.
+//
+// JsonStreamParser takes the input a chunk at a time, as curl hands it over, and reports
+// what it finds to a JsonHandler as soon as each token is complete. Nothing is kept beyond
+// the token in progress and the nesting stack, so memory does not grow with the document and
+// the first fields are available before the rest has arrived. A handler can stop the parse
+// early once it has what it needs. JsonFieldExtractor is a handler that picks out the values
+// at a few paths.
+
+enum class JsonType : std::uint8_t {
+    STRING,
+    NUMBER, // the text as written, e.g. "-1.5e3"
+    BOOLEAN,
+    NONE    // null
+};
+
+// Receives parse events. The string_views are only valid during the call.
+class JsonHandler {
+public:
+    virtual ~JsonHandler() = default;
+
+    virtual void startObject() {}
+    virtual void endObject() {}
+    virtual void startArray() {}
+    virtual void endArray() {}
+    virtual void key(std::string_view) {}
+    // Strings are unescaped; numbers, true, false and null come as written
+    virtual void value(JsonType, std::string_view) {}
+
+    bool stopRequested() const { return stopRequested_; }
+
+protected:
+    // Ask the parser to stop after the current event; the rest of the input is ignored
+    void requestStop() { stopRequested_ = true; }
+
+private:
+    bool stopRequested_ = false;
+};
+
+class JsonStreamParser {
+public:
+    static constexpr std::size_t kMaxDepth = 512;
+
+    explicit JsonStreamParser(JsonHandler& handler) : handler_(handler) {}
+
+    // Parse the next chunk. Returns false once the input is invalid or the handler asked to
+    // stop; further input is then ignored.
+    bool feed(std::string_view chunk) {
+        if (failed() || stopped()) {
+            return false;
+        }
+        const char* data = chunk.data();
+        std::size_t size = chunk.size();
+        std::uint64_t base = consumed_;
+        for (std::size_t i = 0; i < size; ++i) {
+            consumed_ = base + i;
+            char c = data[i];
+            switch (lex_) {
+                case Lex::STRING: {
+                    // Copy the plain run up to the next quote, escape or control character in one go
+                    std::size_t end = i;
+                    while (end < size && data[end] != '"' && data[end] != '\\' && static_cast<unsigned char>(data[end]) >= 0x20) {
+                        ++end;
+                    }
+                    if (end > i && highSurrogate_ != 0) {
+                        return fail("Unpaired surrogate in string");
+                    }
+                    token_.append(data + i, end - i);
+                    i = end;
+                    consumed_ = base + i;
+                    if (i == size) {
+                        break;
+                    }
+                    c = data[i];
+                    if (c == '"') {
+                        if (highSurrogate_ != 0) {
+                            return fail("Unpaired surrogate in string");
+                        }
+                        lex_ = Lex::NONE;
+                        if (stringIsKey_) {
+                            handler_.key(token_);
+                            expect_ = Expect::COLON;
+                        } else {
+                            handler_.value(JsonType::STRING, token_);
+                            afterValue();
+                        }
+                    } else if (c == '\\') {
+                        lex_ = Lex::ESCAPE;
+                    } else {
+                        return fail("Control character in string");
+                    }
+                    break;
+                }
+                case Lex::ESCAPE:
+                    if (!escape(c)) {
+                        return false;
+                    }
+                    break;
+                case Lex::UNICODE:
+                    if (!unicodeDigit(c)) {
+                        return false;
+                    }
+                    break;
+                case Lex::NUMBER:
+                    if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                        token_.push_back(c);
+                        break;
+                    }
+                    if (!finishNumber()) {
+                        return false;
+                    }
+                    --i; // c belongs to whatever follows the number
+                    break;
+                case Lex::LITERAL:
+                    if (c != literal_[token_.size()]) {
+                        return fail("Invalid literal");
+                    }
+                    token_.push_back(c);
+                    if (token_.size() == literal_.size()) {
+                        lex_ = Lex::NONE;
+                        handler_.value(literal_ == "null" ? JsonType::NONE : JsonType::BOOLEAN, token_);
+                        afterValue();
+                    }
+                    break;
+                case Lex::NONE:
+                    if (!structural(c)) {
+                        return false;
+                    }
+                    break;
+            }
+            if (handler_.stopRequested()) {
+                consumed_ = base + i + 1;
+                return false;
+            }
+        }
+        consumed_ = base + size;
+        return true;
+    }
+
+    // Signal the end of input. Returns whether a complete document was parsed (or the handler
+    // stopped early).
+    bool finish() {
+        if (stopped()) {
+            return true;
+        }
+        if (failed()) {
+            return false;
+        }
+        if (lex_ == Lex::NUMBER && !finishNumber()) {
+            return false;
+        }
+        if (lex_ != Lex::NONE || expect_ != Expect::DONE) {
+            return fail("Truncated JSON");
+        }
+        return true;
+    }
+
+    bool failed() const { return !error_.empty(); }
+    bool stopped() const { return handler_.stopRequested(); }
+    const std::string& error() const { return error_; }
+
+    // Input bytes taken so far; on failure, the offset of the offending byte
+    std::uint64_t consumed() const { return consumed_; }
+
+private:
+    enum class Lex : std::uint8_t { NONE, STRING, ESCAPE, UNICODE, NUMBER, LITERAL };
+    enum class Expect : std::uint8_t { VALUE, VALUE_OR_END, KEY, KEY_OR_END, COLON, COMMA_OR_END, DONE };
+
+    JsonHandler& handler_;
+    Lex lex_ = Lex::NONE;
+    Expect expect_ = Expect::VALUE;
+    std::vector<char> stack_; // '{' or '[' per open container
+    std::string token_;       // string, number or literal in progress; reused
+    std::string_view literal_;
+    bool stringIsKey_ = false;
+    std::uint32_t unicode_ = 0;
+    int unicodeDigits_ = 0;
+    std::uint32_t highSurrogate_ = 0;
+    std::uint64_t consumed_ = 0;
+    std::string error_;
+
+    bool fail(const char* message) {
+        error_ = std::string(message) + " at byte " + std::to_string(consumed_);
+        return false;
+    }
+
+    bool structural(char c) {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            return true;
+        }
+        switch (expect_) {
+            case Expect::VALUE_OR_END:
+                if (c == ']') {
+                    return closeContainer(c);
+                }
+                return startValue(c);
+            case Expect::VALUE:
+                return startValue(c);
+            case Expect::KEY_OR_END:
+                if (c == '}') {
+                    return closeContainer(c);
+                }
+                [[fallthrough]];
+            case Expect::KEY:
+                if (c != '"') {
+                    return fail("Expected a key");
+                }
+                startString(true);
+                return true;
+            case Expect::COLON:
+                if (c != ':') {
+                    return fail("Expected ':'");
+                }
+                expect_ = Expect::VALUE;
+                return true;
+            case Expect::COMMA_OR_END:
+                if (c == ',') {
+                    expect_ = stack_.back() == '{' ? Expect::KEY : Expect::VALUE;
+                    return true;
+                }
+                if (c == '}' || c == ']') {
+                    return closeContainer(c);
+                }
+                return fail("Expected ',' or the end of a container");
+            case Expect::DONE:
+                return fail("Data after the end of the document");
+        }
+        return false;
+    }
+
+    bool startValue(char c) {
+        switch (c) {
+            case '{':
+            case '[':
+                if (stack_.size() >= kMaxDepth) {
+                    return fail("JSON nested too deeply");
+                }
+                stack_.push_back(c);
+                if (c == '{') {
+                    handler_.startObject();
+                    expect_ = Expect::KEY_OR_END;
+                } else {
+                    handler_.startArray();
+                    expect_ = Expect::VALUE_OR_END;
+                }
+                return true;
+            case '"':
+                startString(false);
+                return true;
+            case 't':
+                return startLiteral("true");
+            case 'f':
+                return startLiteral("false");
+            case 'n':
+                return startLiteral("null");
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    token_.assign(1, c);
+                    lex_ = Lex::NUMBER;
+                    return true;
+                }
+                return fail("Unexpected character");
+        }
+    }
+
+    bool closeContainer(char c) {
+        char open = stack_.back();
+        if ((c == '}') != (open == '{')) {
+            return fail("Mismatched bracket");
+        }
+        stack_.pop_back();
+        if (c == '}') {
+            handler_.endObject();
+        } else {
+            handler_.endArray();
+        }
+        afterValue();
+        return true;
+    }
+
+    void afterValue() {
+        expect_ = stack_.empty() ? Expect::DONE : Expect::COMMA_OR_END;
+    }
+
+    void startString(bool isKey) {
+        token_.clear();
+        stringIsKey_ = isKey;
+        lex_ = Lex::STRING;
+    }
+
+    bool startLiteral(std::string_view literal) {
+        literal_ = literal;
+        token_.assign(1, literal[0]);
+        lex_ = Lex::LITERAL;
+        return true;
+    }
+
+    bool escape(char c) {
+        if (highSurrogate_ != 0 && c != 'u') {
+            return fail("Unpaired surrogate in string");
+        }
+        char decoded;
+        switch (c) {
+            case '"': decoded = '"'; break;
+            case '\\': decoded = '\\'; break;
+            case '/': decoded = '/'; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u':
+                unicode_ = 0;
+                unicodeDigits_ = 0;
+                lex_ = Lex::UNICODE;
+                return true;
+            default:
+                return fail("Invalid escape");
+        }
+        token_.push_back(decoded);
+        lex_ = Lex::STRING;
+        return true;
+    }
+
+    bool unicodeDigit(char c) {
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                  : -1;
+        if (digit < 0) {
+            return fail("Invalid \\u escape");
+        }
+        unicode_ = unicode_ << 4 | static_cast<std::uint32_t>(digit);
+        if (++unicodeDigits_ < 4) {
+            return true;
+        }
+        lex_ = Lex::STRING;
+        std::uint32_t code = unicode_;
+        if (highSurrogate_ != 0) {
+            if (code < 0xDC00 || code > 0xDFFF) {
+                return fail("Unpaired surrogate in string");
+            }
+            code = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (code - 0xDC00);
+            highSurrogate_ = 0;
+        } else if (code >= 0xD800 && code <= 0xDBFF) {
+            highSurrogate_ = code; // the low half follows as another \u escape
+            return true;
+        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+            return fail("Unpaired surrogate in string");
+        }
+        appendUtf8(code);
+        return true;
+    }
+
+    void appendUtf8(std::uint32_t code) {
+        if (code < 0x80) {
+            token_.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            token_.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            token_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            token_.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            token_.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            token_.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            token_.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            token_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    static bool validNumber(std::string_view text) {
+        std::size_t i = 0;
+        auto digits = [&]() {
+            std::size_t start = i;
+            while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+                ++i;
+            }
+            return i > start;
+        };
+        if (i < text.size() && text[i] == '-') {
+            ++i;
+        }
+        if (i < text.size() && text[i] == '0') {
+            ++i;
+        } else if (!digits()) {
+            return false;
+        }
+        if (i < text.size() && text[i] == '.') {
+            ++i;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+            ++i;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+                ++i;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return i == text.size();
+    }
+
+    bool finishNumber() {
+        if (!validNumber(token_)) {
+            return fail("Invalid number");
+        }
+        lex_ = Lex::NONE;
+        handler_.value(JsonType::NUMBER, token_);
+        afterValue();
+        return true;
+    }
+};
+
+// Picks out the scalar values at a set of paths. A path is a JSON pointer ("/user/name",
+// "/statuses/0/id") where "*" matches any key or array index ("/statuses/*/id").
+class JsonFieldExtractor : public JsonHandler {
+public:
+    // field is the index of the matching path in the list given to the constructor
+    using Callback = std::function<void(std::size_t field, JsonType type, std::string_view value)>;
+
+    // With stopWhenFound the parse stops once every path without a "*" has matched
+    JsonFieldExtractor(const std::vector<std::string>& paths, Callback callback, bool stopWhenFound = false)
+        : callback_(std::move(callback)), stopWhenFound_(stopWhenFound) {
+        for (const auto& path : paths) {
+            Pattern pattern;
+            std::size_t start = path.empty() || path[0] != '/' ? 0 : 1;
+            while (start <= path.size() && !path.empty()) {
+                std::size_t end = path.find('/', start);
+                if (end == std::string::npos) {
+                    end = path.size();
+                }
+                Segment segment;
+                segment.key = path.substr(start, end - start);
+                segment.any = segment.key == "*";
+                segment.numeric = !segment.key.empty() && segment.key.find_first_not_of("0123456789") == std::string::npos;
+                if (segment.numeric) {
+                    segment.index = std::stoull(segment.key);
+                }
+                pattern.wildcard = pattern.wildcard || segment.any;
+                pattern.segments.push_back(std::move(segment));
+                start = end + 1;
+            }
+            remaining_ += pattern.wildcard ? 0 : 1;
+            patterns_.push_back(std::move(pattern));
+        }
+    }
+
+    void startObject() override { push(false); }
+    void startArray() override { push(true); }
+    void endObject() override { pop(); }
+    void endArray() override { pop(); }
+
+    void key(std::string_view name) override {
+        frames_.back().key.assign(name);
+    }
+
+    void value(JsonType type, std::string_view text) override {
+        for (std::size_t i = 0; i < patterns_.size(); ++i) {
+            Pattern& pattern = patterns_[i];
+            if (!matches(pattern)) {
+                continue;
+            }
+            callback_(i, type, text);
+            if (!pattern.wildcard && !pattern.found) {
+                pattern.found = true;
+                if (--remaining_ == 0 && stopWhenFound_) {
+                    requestStop();
+                }
+            }
+        }
+        advance();
+    }
+
+private:
+    struct Segment {
+        std::string key;
+        bool any = false;     // "*"
+        bool numeric = false; // also matches array index
+        std::size_t index = 0;
+    };
+
+    struct Pattern {
+        std::vector<Segment> segments;
+        bool wildcard = false;
+        bool found = false;
+    };
+
+    struct Frame {
+        bool array;
+        std::size_t index = 0;
+        std::string key;
+    };
+
+    std::vector<Pattern> patterns_;
+    Callback callback_;
+    bool stopWhenFound_;
+    std::size_t remaining_ = 0;
+    std::vector<Frame> frames_;
+
+    void push(bool array) {
+        frames_.push_back({array, 0, std::string()});
+    }
+
+    void pop() {
+        frames_.pop_back();
+        advance();
+    }
+
+    // Step past the value just finished in the enclosing array
+    void advance() {
+        if (!frames_.empty() && frames_.back().array) {
+            ++frames_.back().index;
+        }
+    }
+
+    bool matches(const Pattern& pattern) const {
+        if (pattern.segments.size() != frames_.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < frames_.size(); ++i) {
+            const Segment& segment = pattern.segments[i];
+            const Frame& frame = frames_[i];
+            if (!segment.any && (frame.array ? !segment.numeric || segment.index != frame.index : segment.key != frame.key)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
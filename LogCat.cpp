@@ -0,0 +1,50 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "DataRecordFormat.h"
+#include "DataLogCompression.h"
+
+// Decode a binary DataRecorder log to text, one event per line
+void decodeLog(std::istream& in, std::ostream& out) {
+    BinaryRecordDecoder decoder;
+    BinaryEvent event;
+    std::string body;
+    std::string line;
+    while (BinaryRecordDecoder::readRecord(in, body)) {
+        if (decoder.decode(body, event)) {
+            line.clear();
+            BinaryRecordDecoder::formatEvent(event, line);
+            line.push_back('\n');
+            out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        }
+    }
+}
+
+// ve-logcat: decodes binary DataRecorder logs (files, compressed .lz segments, or stdin when none are given)
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    try {
+        if (argc < 2) {
+            decodeLog(std::cin, std::cout);
+        }
+        for (int i = 1; i < argc; ++i) {
+            if (isCompressedLogPath(argv[i])) {
+                CompressedLogReader reader(argv[i]);
+                std::istream in(&reader);
+                decodeLog(in, std::cout);
+                continue;
+            }
+            std::ifstream in(argv[i], std::ios::binary);
+            if (!in.is_open()) {
+                throw std::runtime_error(std::string("Could not open ") + argv[i]);
+            }
+            decodeLog(in, std::cout);
+        }
+    } catch (const std::exception& e) {
+        std::cout.flush();
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <limits>
+#include "DataRecordFormat.h"
+#include "DataLogIndex.h"
+#include "DataLogCompression.h"
+
+// Query window, in realtime nanoseconds since the epoch
+struct TimeWindow {
+    std::int64_t from = std::numeric_limits<std::int64_t>::min();
+    std::int64_t to = std::numeric_limits<std::int64_t>::max();
+
+    bool contains(std::int64_t nanos) const { return nanos >= from && nanos <= to; }
+    bool overlaps(std::int64_t start, std::int64_t unit) const { return start + unit - 1 >= from && start <= to; }
+    // Whether a block can hold matching lines when the log writes its times truncated to unit.
+    // The index keeps exact times, so they are truncated the same way before comparing.
+    bool overlaps(const DataLogIndexEntry& entry, std::int64_t unit) const {
+        return overlaps(entry.maxNanos - entry.maxNanos % unit, unit) && entry.minNanos - entry.minNanos % unit <= to;
+    }
+};
+
+struct QueryStats {
+    std::uint64_t bytesTotal = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t blocksRead = 0;
+    std::uint64_t blocksSkipped = 0;
+    std::uint64_t matches = 0;
+    std::uint64_t compressedBytesRead = 0; // of .lz segments, which bytesRead counts uncompressed
+};
+
+// Parse a local "YYYY-MM-DD HH:MM:SS[.fraction]" timestamp, as DataRecorder writes them.
+// unit is the span the text stands for: a second, or less with fraction digits.
+// mktime runs once per distinct minute; log lines mostly repeat the previous one.
+bool parseLocalTime(std::string_view text, std::int64_t& nanos, std::int64_t& unit) {
+    static std::string cachedMinute;
+    static std::int64_t cachedSeconds = 0;
+
+    if (text.size() < 19 || text[4] != '-' || text[7] != '-' || text[10] != ' ' || text[13] != ':' || text[16] != ':') {
+        return false;
+    }
+    auto digits = [&](std::size_t offset, std::size_t count, int& value) {
+        value = 0;
+        for (std::size_t i = offset; i < offset + count; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    };
+    int second;
+    if (!digits(17, 2, second)) {
+        return false;
+    }
+    if (text.substr(0, 16) != cachedMinute) {
+        std::tm tm{};
+        if (!digits(0, 4, tm.tm_year) || !digits(5, 2, tm.tm_mon) || !digits(8, 2, tm.tm_mday) ||
+            !digits(11, 2, tm.tm_hour) || !digits(14, 2, tm.tm_min)) {
+            return false;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        tm.tm_isdst = -1;
+        cachedSeconds = static_cast<std::int64_t>(std::mktime(&tm));
+        cachedMinute.assign(text.substr(0, 16));
+    }
+
+    std::int64_t fraction = 0;
+    unit = 1000000000;
+    if (text.size() > 20 && text[19] == '.') {
+        for (std::size_t i = 20; i < text.size() && text[i] >= '0' && text[i] <= '9' && unit > 1; ++i) {
+            unit /= 10;
+            fraction += (text[i] - '0') * unit;
+        }
+    }
+    nanos = (cachedSeconds + second) * 1000000000 + fraction;
+    return true;
+}
+
+// The precision a text log writes its times at, from its first line; a second if it has none
+std::int64_t textTimeUnit(std::istream& in) {
+    std::string line;
+    std::int64_t nanos;
+    std::int64_t unit = 1000000000;
+    if (std::getline(in, line) && !parseLocalTime(line, nanos, unit)) {
+        unit = 1000000000;
+    }
+    in.clear();
+    in.seekg(0);
+    return unit;
+}
+
+bool isBinaryLog(std::istream& in) {
+    char start[sizeof(std::uint32_t) + 1 + sizeof(kBinaryLogMagic)];
+    bool binary = in.read(start, sizeof(start)) &&
+                  static_cast<BinaryRecordKind>(start[sizeof(std::uint32_t)]) == BinaryRecordKind::SESSION &&
+                  std::memcmp(start + sizeof(std::uint32_t) + 1, kBinaryLogMagic, sizeof(kBinaryLogMagic)) == 0;
+    in.clear();
+    return binary;
+}
+
+// A byte range of the log to stream, ending on a record boundary
+struct ReadRange {
+    std::uint64_t offset;
+    std::uint64_t length;
+};
+
+// Work out which parts of the log can hold records in window, with the log's times written at
+// unit precision. Ranges the index does not cover are always read; binary blocks that define
+// formats are read so later events decode.
+std::vector<ReadRange> planReads(const std::vector<DataLogIndexEntry>& entries, std::uint64_t fileSize, bool binary,
+                                 std::int64_t unit, const TimeWindow& window, QueryStats& stats) {
+    std::vector<ReadRange> ranges;
+    auto add = [&ranges](std::uint64_t offset, std::uint64_t length) {
+        if (length == 0) {
+            return;
+        }
+        if (!ranges.empty() && ranges.back().offset + ranges.back().length == offset) {
+            ranges.back().length += length;
+        } else {
+            ranges.push_back({offset, length});
+        }
+    };
+
+    std::uint64_t covered = 0;
+    for (const auto& entry : entries) {
+        // Entries that do not line up are stale or damaged; what they claim to cover is scanned instead
+        if (entry.offset < covered || entry.records == 0 || entry.length > fileSize || entry.offset > fileSize - entry.length) {
+            continue;
+        }
+        add(covered, entry.offset - covered);
+        if (window.overlaps(entry, unit) || (binary && (entry.flags & kDataLogIndexDefinitions))) {
+            add(entry.offset, entry.length);
+            ++stats.blocksRead;
+        } else {
+            ++stats.blocksSkipped;
+        }
+        covered = entry.offset + entry.length;
+    }
+    add(covered, fileSize - covered);
+    return ranges;
+}
+
+void queryText(std::istream& in, const std::vector<ReadRange>& ranges, const TimeWindow& window, std::ostream& out, QueryStats& stats) {
+    std::string line;
+    for (const auto& range : ranges) {
+        in.seekg(static_cast<std::streamoff>(range.offset));
+        std::uint64_t position = range.offset;
+        bool matching = false;
+        while (position < range.offset + range.length && std::getline(in, line)) {
+            position += line.size() + 1;
+            std::int64_t nanos;
+            std::int64_t unit;
+            // Lines without a timestamp continue a multi-line record
+            if (parseLocalTime(line, nanos, unit)) {
+                matching = window.overlaps(nanos, unit);
+                stats.matches += matching;
+            }
+            if (matching) {
+                out << line << '\n';
+            }
+        }
+        in.clear();
+        stats.bytesRead += range.length;
+    }
+}
+
+void queryBinary(std::istream& in, const std::vector<ReadRange>& ranges, const TimeWindow& window, std::ostream& out, QueryStats& stats) {
+    BinaryRecordDecoder decoder;
+    BinaryEvent event;
+    std::string body;
+    std::string line;
+    for (const auto& range : ranges) {
+        in.seekg(static_cast<std::streamoff>(range.offset));
+        std::uint64_t position = range.offset;
+        while (position < range.offset + range.length && BinaryRecordDecoder::readRecord(in, body)) {
+            position += sizeof(std::uint32_t) + body.size();
+            if (decoder.decode(body, event) && window.contains(event.realtimeNanos)) {
+                line.clear();
+                BinaryRecordDecoder::formatEvent(event, line);
+                line.push_back('\n');
+                out.write(line.data(), static_cast<std::streamsize>(line.size()));
+                ++stats.matches;
+            }
+        }
+        stats.bytesRead += range.length;
+    }
+}
+
+void queryStream(std::istream& in, const std::string& path, std::uint64_t fileSize, const TimeWindow& window, std::ostream& out,
+                 QueryStats& stats) {
+    stats.bytesTotal += fileSize;
+    bool binary = isBinaryLog(in);
+    // Binary events keep exact times
+    std::int64_t unit = binary ? 1 : textTimeUnit(in);
+    std::vector<ReadRange> ranges = planReads(loadDataLogIndex(path), fileSize, binary, unit, window, stats);
+    if (binary) {
+        queryBinary(in, ranges, window, out, stats);
+    } else {
+        queryText(in, ranges, window, out, stats);
+    }
+}
+
+void queryLog(const std::string& path, const TimeWindow& window, std::ostream& out, QueryStats& stats) {
+    // Compressed segments read as the original bytes, so the segment's index applies unchanged
+    if (isCompressedLogPath(path)) {
+        CompressedLogReader reader(path);
+        std::istream in(&reader);
+        queryStream(in, uncompressedLogPath(path), reader.rawSize(), window, out, stats);
+        stats.compressedBytesRead += reader.bytesRead();
+        return;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    queryStream(in, path, std::filesystem::file_size(path), window, out, stats);
+}
+
+bool endsWith(const std::string& text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void printUsage() {
+    std::cerr << "Usage: ve-logquery [--from TIME] [--to TIME] [--stats] LOG...\n"
+              << "  TIME is local \"YYYY-MM-DD HH:MM:SS[.fraction]\"; both ends are inclusive, to the precision given.\n"
+              << "  LOG is a DataRecorder log or segment, text or binary, possibly compressed (.lz);\n"
+              << "  its .idx sidecar is used when present.\n";
+}
+
+// ve-logquery: prints the records of DataRecorder logs that fall in a time window,
+// seeking past the blocks their sidecar indexes rule out
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+    try {
+        TimeWindow window;
+        bool printStats = false;
+        std::vector<std::string> logs;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if ((arg == "--from" || arg == "--to") && i + 1 < argc) {
+                std::int64_t nanos;
+                std::int64_t unit;
+                if (!parseLocalTime(argv[++i], nanos, unit)) {
+                    throw std::invalid_argument(std::string("Bad time ") + argv[i]);
+                }
+                // "--to 12:00:05" runs to the end of that second
+                (arg == "--from" ? window.from : window.to) = arg == "--from" ? nanos : nanos + unit - 1;
+            } else if (arg == "--stats") {
+                printStats = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                printUsage();
+                return 1;
+            } else if (!endsWith(arg, ".idx") && !endsWith(arg, ".tmp")) {
+                // Index sidecars are picked up with their logs, and segments being compressed are
+                // still there uncompressed, so a "data.log.*" glob just works
+                logs.push_back(arg);
+            }
+        }
+        if (logs.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        QueryStats stats;
+        for (const auto& log : logs) {
+            queryLog(log, window, std::cout, stats);
+        }
+        std::cout.flush();
+        if (printStats) {
+            std::cerr << stats.matches << " records; read " << stats.bytesRead << " of " << stats.bytesTotal << " bytes, "
+                      << stats.blocksRead << " indexed blocks read, " << stats.blocksSkipped << " skipped";
+            if (stats.compressedBytesRead > 0) {
+                std::cerr << "; " << stats.compressedBytesRead << " compressed bytes read";
+            }
+            std::cerr << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cout.flush();
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "DataSinks.h"
+
+// Levels below this are compiled out: 0 DEBUG, 1 INFO, 2 WARNING, 3 ERROR.
+// Build with e.g. -DVE_LOG_MIN_LEVEL=2 to keep only warnings and errors.
+#ifndef VE_LOG_MIN_LEVEL
+#define VE_LOG_MIN_LEVEL 1
+#endif
+
+// The same levels DataRecorder's sinks filter on
+using LogLevel = RecordLevel;
+
+// A key/value pair attached to a log line. It only refers to its key and string value, so
+// building one allocates nothing; both must outlive the log() call, which copies them.
+class LogField {
+public:
+    LogField(std::string_view key, std::string_view value) : key_(key), kind_(Kind::TEXT), text_(value) {}
+    LogField(std::string_view key, const std::string& value) : LogField(key, std::string_view(value)) {}
+    LogField(std::string_view key, const char* value) : LogField(key, std::string_view(value)) {}
+    LogField(std::string_view key, bool value) : key_(key), kind_(Kind::BOOLEAN), integer_(value) {}
+    LogField(std::string_view key, double value) : key_(key), kind_(Kind::REAL), real_(value) {}
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    LogField(std::string_view key, T value)
+        : key_(key), kind_(std::is_signed_v<T> ? Kind::INTEGER : Kind::UNSIGNED), integer_(static_cast<std::int64_t>(value)) {}
+
+private:
+    friend class Logger;
+
+    enum class Kind : std::uint8_t { TEXT, INTEGER, UNSIGNED, REAL, BOOLEAN };
+
+    std::string_view key_;
+    Kind kind_;
+    std::string_view text_;
+    std::int64_t integer_ = 0;
+    double real_ = 0;
+};
+
+struct LoggerOptions {
+    std::size_t capacity = 4096; // queued lines, rounded up to a power of two; more are dropped
+};
+
+// Appends "[timestamp] [LEVEL] message key=value ..." lines to a file. Callers format their
+// line straight into a slot of a SinkChannel's lock-free queue and return; the channel's thread
+// writes the queued lines through a FileSink, flushing once per batch. The caller never waits on
+// the file, a lock or the writer: when the queue is full the line is dropped and counted in
+// stats(). Levels below VE_LOG_MIN_LEVEL are removed at compile time.
+//
+//   logger.log<LogLevel::INFO>("API call finished", {{"url", url}, {"seconds", result.seconds}});
+class Logger {
+public:
+    struct Stats {
+        std::uint64_t written = 0;
+        std::uint64_t dropped = 0; // the queue was full
+    };
+
+    // Throws std::runtime_error if the file cannot be opened. Destroying the logger writes out
+    // everything queued so far.
+    explicit Logger(const std::string& filename, const LoggerOptions& options = LoggerOptions())
+        : channel_(std::make_shared<FileSink>(filename, TimestampPrecision::SECONDS, FileSinkStyle::LEVELED),
+                   SinkOptions{RecordLevel::DEBUG, 1.0, options.capacity}) {}
+
+    static constexpr bool enabled(LogLevel level) {
+        return static_cast<int>(level) >= VE_LOG_MIN_LEVEL;
+    }
+
+    template<LogLevel Level>
+    void log(std::string_view message, std::initializer_list<LogField> fields = {}) {
+        if constexpr (enabled(Level)) {
+            std::int64_t time = std::chrono::system_clock::now().time_since_epoch().count();
+            channel_.offerInPlace(time, Level, [&](SinkRecord& record) {
+                LineWriter line{record.data, 0, false};
+                line.append(message);
+                for (const LogField& field : fields) {
+                    line.append(' ');
+                    line.append(field.key_);
+                    line.append('=');
+                    appendValue(line, field);
+                }
+                record.length = static_cast<std::uint32_t>(line.length);
+                record.truncated = line.truncated;
+            });
+        }
+    }
+
+    Stats stats() const {
+        Stats stats;
+        stats.written = channel_.delivered();
+        stats.dropped = channel_.dropped();
+        return stats;
+    }
+
+private:
+    SinkChannel channel_;
+
+    // Fills a record's payload, cutting the line short rather than overflowing it
+    struct LineWriter {
+        char* data;
+        std::size_t length;
+        bool truncated;
+
+        void append(std::string_view text) {
+            std::size_t room = SinkRecord::kPayload - length;
+            if (text.size() > room) {
+                truncated = true;
+            }
+            std::size_t count = std::min(text.size(), room);
+            std::memcpy(data + length, text.data(), count);
+            length += count;
+        }
+
+        void append(char c) { append(std::string_view(&c, 1)); }
+    };
+
+    // Strings go in quotes when they hold spaces, quotes, '=' or control characters
+    static void appendValue(LineWriter& line, const LogField& field) {
+        char number[32];
+        std::to_chars_result result{number, std::errc()};
+        switch (field.kind_) {
+            case LogField::Kind::TEXT: {
+                bool quote = field.text_.empty() ||
+                             std::any_of(field.text_.begin(), field.text_.end(),
+                                         [](char c) { return c == ' ' || c == '"' || c == '=' || static_cast<unsigned char>(c) < 0x20; });
+                if (!quote) {
+                    line.append(field.text_);
+                    return;
+                }
+                line.append('"');
+                for (char c : field.text_) {
+                    if (c == '"' || c == '\\') {
+                        line.append('\\');
+                        line.append(c);
+                    } else if (c == '\n') {
+                        line.append("\\n");
+                    } else if (c == '\r') {
+                        line.append("\\r");
+                    } else if (c == '\t') {
+                        line.append("\\t");
+                    } else {
+                        line.append(c);
+                    }
+                }
+                line.append('"');
+                return;
+            }
+            case LogField::Kind::INTEGER:
+                result = std::to_chars(number, number + sizeof(number), field.integer_);
+                break;
+            case LogField::Kind::UNSIGNED:
+                result = std::to_chars(number, number + sizeof(number), static_cast<std::uint64_t>(field.integer_));
+                break;
+            case LogField::Kind::REAL:
+                result = std::to_chars(number, number + sizeof(number), field.real_);
+                break;
+            case LogField::Kind::BOOLEAN:
+                line.append(field.integer_ ? "true" : "false");
+                return;
+        }
+        line.append(std::string_view(number, static_cast<std::size_t>(result.ptr - number)));
+    }
+};
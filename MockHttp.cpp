@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include <pthread.h>
+#include <stdexcept>
+#include "MockHttpServer.h"
+
+// Runs MockHttpServer until interrupted, so the Twitter clients and BotUtilities can be pointed
+// at it instead of the real APIs, e.g. `TwitterClient --base-url http://127.0.0.1:8080`.
+
+void printUsage() {
+    std::cerr << "Usage: ve-mockhttp [--port N] [--latency-us N] [--error-rate F] [--payload-bytes N]\n"
+              << "                   [--stream-bytes N] [--chunk-bytes N] [--seed N]\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        MockHttpOptions options;
+        options.port = 8080;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--port" && hasValue) {
+                options.port = std::stoi(argv[++i]);
+            } else if (arg == "--latency-us" && hasValue) {
+                options.latency = std::chrono::microseconds(std::stoll(argv[++i]));
+            } else if (arg == "--error-rate" && hasValue) {
+                options.errorRate = std::stod(argv[++i]);
+            } else if (arg == "--payload-bytes" && hasValue) {
+                options.payloadBytes = std::stoull(argv[++i]);
+            } else if (arg == "--stream-bytes" && hasValue) {
+                options.streamBytes = std::stoull(argv[++i]);
+            } else if (arg == "--chunk-bytes" && hasValue) {
+                options.streamChunkBytes = std::stoull(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = std::stoull(argv[++i]);
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+
+        // Block the signals before the server starts its threads, then wait for one here
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        MockHttpServer server(options);
+        std::cout << "Serving mock HTTP on " << server.baseUrl() << std::endl;
+        int signal = 0;
+        sigwait(&signals, &signal);
+
+        MockHttpServer::Stats stats = server.stats();
+        std::cout << stats.requests << " requests on " << stats.connections << " connections, "
+                  << stats.errors << " errors, " << stats.bytesSent << " bytes sent" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
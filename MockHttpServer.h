@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct MockHttpOptions {
+    int port = 0;                            // 0 picks a free port; see MockHttpServer::port()
+    std::chrono::microseconds latency{0};    // added before every response
+    double errorRate = 0;                    // fraction of requests answered 503 with Retry-After
+    std::size_t payloadBytes = 1024;         // size of the JSON body of ordinary responses
+    std::size_t streamBytes = 0;             // per streaming response; 0 streams until the client hangs up
+    std::size_t streamChunkBytes = 16384;    // size of each chunk of a streaming response
+    std::uint64_t seed = 1;                  // for the error draws, so runs are repeatable
+};
+
+// A loopback HTTP/1.1 server that stands in for the Twitter APIs and other JSON endpoints, so
+// clients can be exercised and benchmarked offline. Connections are kept alive and served one
+// thread each. Requests to /1.1/statuses/filter.json or /stream get a chunked stream of
+// newline-delimited tweet objects, like the streaming API; everything else, e.g. a POST to
+// /1.1/statuses/update.json, gets a JSON object of MockHttpOptions::payloadBytes. Request
+// bodies are read and discarded.
+class MockHttpServer {
+public:
+    struct Stats {
+        std::uint64_t connections = 0; // accepted; requests / connections is the reuse ratio
+        std::uint64_t requests = 0;
+        std::uint64_t errors = 0;      // answered 503 on purpose
+        std::uint64_t bytesSent = 0;
+    };
+
+    explicit MockHttpServer(const MockHttpOptions& options = MockHttpOptions())
+        : options_(options), payload_(tweetJson(1, options.payloadBytes)),
+          streamChunk_(chunkOf(std::max<std::size_t>(options.streamChunkBytes, 256))) {
+        listenFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0) {
+            throw std::runtime_error("Could not create mock server socket");
+        }
+        int reuse = 1;
+        ::setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(options.port));
+        socklen_t length = sizeof(address);
+        if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd_, 512) != 0 ||
+            ::getsockname(listenFd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            ::close(listenFd_);
+            throw std::runtime_error("Could not listen for mock HTTP on port " + std::to_string(options.port));
+        }
+        port_ = ntohs(address.sin_port);
+        thread_ = std::thread(&MockHttpServer::serve, this);
+    }
+
+    // Drops open connections, including streams in progress
+    ~MockHttpServer() {
+        stop_.store(true);
+        thread_.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& connection : connections_) {
+                ::shutdown(connection->fd, SHUT_RDWR);
+            }
+        }
+        for (auto& connection : connections_) {
+            connection->thread.join();
+            ::close(connection->fd);
+        }
+        ::close(listenFd_);
+    }
+
+    MockHttpServer(const MockHttpServer&) = delete;
+    MockHttpServer& operator=(const MockHttpServer&) = delete;
+
+    int port() const { return port_; }
+
+    // "http://127.0.0.1:port", to use in place of e.g. https://api.twitter.com
+    std::string baseUrl() const { return "http://127.0.0.1:" + std::to_string(port_); }
+
+    Stats stats() const {
+        Stats stats;
+        stats.connections = connectionCount_.load(std::memory_order_relaxed);
+        stats.requests = requests_.load(std::memory_order_relaxed);
+        stats.errors = errors_.load(std::memory_order_relaxed);
+        stats.bytesSent = bytesSent_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    struct Request {
+        std::string method;
+        std::string target;
+        bool close = false;
+    };
+
+    MockHttpOptions options_;
+    std::string payload_;
+    std::string streamChunk_; // one full chunk, framing included, sent over and over
+    int listenFd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+
+    std::atomic<std::uint64_t> connectionCount_{0};
+    std::atomic<std::uint64_t> requests_{0};
+    std::atomic<std::uint64_t> errors_{0};
+    std::atomic<std::uint64_t> bytesSent_{0};
+
+    void serve() {
+        while (!stop_.load()) {
+            pollfd listening{listenFd_, POLLIN, 0};
+            if (::poll(&listening, 1, 200) <= 0) {
+                continue;
+            }
+            int client = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                continue;
+            }
+            int noDelay = 1;
+            ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            connectionCount_.fetch_add(1, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            reapLocked();
+            auto connection = std::make_unique<Connection>();
+            connection->fd = client;
+            Connection* raw = connection.get();
+            connection->thread = std::thread([this, raw, index = connectionCount_.load()]() {
+                converse(raw->fd, options_.seed + index);
+                raw->done.store(true);
+            });
+            connections_.push_back(std::move(connection));
+        }
+    }
+
+    // Join the threads of connections that have ended
+    void reapLocked() {
+        auto finished = std::stable_partition(connections_.begin(), connections_.end(),
+                                              [](const auto& connection) { return !connection->done.load(); });
+        for (auto it = finished; it != connections_.end(); ++it) {
+            (*it)->thread.join();
+            ::close((*it)->fd);
+        }
+        connections_.erase(finished, connections_.end());
+    }
+
+    // Serve requests on one connection until either side closes it
+    void converse(int fd, std::uint64_t seed) {
+        std::mt19937_64 random(seed);
+        std::uniform_real_distribution<double> draw(0.0, 1.0);
+        std::string buffer;
+        Request request;
+        while (!stop_.load() && readRequest(fd, buffer, request)) {
+            requests_.fetch_add(1, std::memory_order_relaxed);
+            if (options_.latency.count() > 0) {
+                std::this_thread::sleep_for(options_.latency);
+            }
+            bool ok;
+            if (options_.errorRate > 0 && draw(random) < options_.errorRate) {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                ok = respond(fd, "503 Service Unavailable", "Retry-After: 1\r\n",
+                             R"({"errors":[{"code":130,"message":"Over capacity"}]})", request.close);
+            } else if (isStream(request.target)) {
+                ok = stream(fd);
+                request.close = true;
+            } else {
+                ok = respond(fd, "200 OK", "", payload_, request.close);
+            }
+            if (!ok || request.close) {
+                break;
+            }
+        }
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+    static bool isStream(std::string_view target) {
+        std::string_view path = target.substr(0, target.find('?'));
+        return path == "/1.1/statuses/filter.json" || path == "/stream";
+    }
+
+    // Read the next request into request, consuming its body; buffer keeps whatever of the
+    // following request has already arrived
+    bool readRequest(int fd, std::string& buffer, Request& request) {
+        std::size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > 65536 || !receive(fd, buffer)) {
+                return false;
+            }
+        }
+        std::string_view head(buffer.data(), headerEnd);
+        std::size_t lineEnd = head.find("\r\n");
+        std::string_view line = head.substr(0, lineEnd);
+        std::size_t space = line.find(' ');
+        std::size_t secondSpace = line.find(' ', space + 1);
+        if (space == std::string_view::npos || secondSpace == std::string_view::npos) {
+            return false;
+        }
+        request.method = std::string(line.substr(0, space));
+        request.target = std::string(line.substr(space + 1, secondSpace - space - 1));
+        request.close = line.substr(secondSpace + 1) == "HTTP/1.0";
+
+        std::size_t contentLength = 0;
+        bool expectContinue = false;
+        std::string_view headers = lineEnd == std::string_view::npos ? std::string_view() : head.substr(lineEnd + 2);
+        while (!headers.empty()) {
+            std::size_t end = headers.find("\r\n");
+            std::string_view header = headers.substr(0, end);
+            headers = end == std::string_view::npos ? std::string_view() : headers.substr(end + 2);
+            std::size_t colon = header.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+            std::string name = lower(header.substr(0, colon));
+            std::string value = lower(trim(header.substr(colon + 1)));
+            if (name == "content-length") {
+                contentLength = static_cast<std::size_t>(std::strtoull(value.c_str(), nullptr, 10));
+            } else if (name == "connection") {
+                request.close = value == "close";
+            } else if (name == "expect") {
+                expectContinue = value == "100-continue";
+            }
+        }
+        buffer.erase(0, headerEnd + 4);
+
+        if (expectContinue && buffer.size() < contentLength && !sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+            return false;
+        }
+        while (buffer.size() < contentLength) {
+            if (!receive(fd, buffer)) {
+                return false;
+            }
+        }
+        buffer.erase(0, contentLength);
+        return true;
+    }
+
+    bool respond(int fd, std::string_view status, std::string_view extraHeaders, std::string_view body, bool close) {
+        std::string response;
+        response.reserve(160 + body.size());
+        response.append("HTTP/1.1 ").append(status).append("\r\n")
+                .append("Content-Type: application/json\r\n")
+                .append("Content-Length: ").append(std::to_string(body.size())).append("\r\n")
+                .append(extraHeaders)
+                .append(close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n")
+                .append(body);
+        return sendAll(fd, response);
+    }
+
+    // Chunked newline-delimited tweets, streamBytes in all or until the client hangs up
+    bool stream(int fd) {
+        if (!sendAll(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                         "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n")) {
+            return false;
+        }
+        std::size_t chunkBytes = std::max<std::size_t>(options_.streamChunkBytes, 256);
+        std::size_t streamed = 0;
+        while (!stop_.load() && (options_.streamBytes == 0 || streamed < options_.streamBytes)) {
+            std::size_t remaining = options_.streamBytes == 0 ? chunkBytes : options_.streamBytes - streamed;
+            bool sent = remaining >= chunkBytes ? sendAll(fd, streamChunk_) : sendAll(fd, chunkOf(remaining));
+            if (!sent) {
+                return false;
+            }
+            streamed += std::min(remaining, chunkBytes);
+        }
+        return sendAll(fd, "0\r\n\r\n");
+    }
+
+    // A chunk carrying exactly bytes bytes of tweets, one per line; the streaming API's
+    // keep-alive newlines make up what is too short for a tweet
+    static std::string chunkOf(std::size_t bytes) {
+        std::string data;
+        data.reserve(bytes);
+        for (std::uint64_t id = 1; bytes - data.size() >= 64; ++id) {
+            data += tweetJson(id, std::min<std::size_t>(bytes - data.size(), 512) - 2);
+            data += "\r\n";
+        }
+        data.append(bytes - data.size(), '\n');
+        char size[24];
+        std::snprintf(size, sizeof(size), "%zx\r\n", data.size());
+        return size + data + "\r\n";
+    }
+
+    bool receive(int fd, std::string& buffer) {
+        char data[16384];
+        for (;;) {
+            pollfd readable{fd, POLLIN, 0};
+            int ready = ::poll(&readable, 1, 200);
+            if (stop_.load()) {
+                return false;
+            }
+            if (ready <= 0) {
+                continue;
+            }
+            ssize_t received = ::recv(fd, data, sizeof(data), 0);
+            if (received <= 0) {
+                return false;
+            }
+            buffer.append(data, static_cast<std::size_t>(received));
+            return true;
+        }
+    }
+
+    bool sendAll(int fd, std::string_view data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t written = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                return false;
+            }
+            sent += static_cast<std::size_t>(written);
+        }
+        bytesSent_.fetch_add(sent, std::memory_order_relaxed);
+        return true;
+    }
+
+    // A tweet-shaped JSON object of about bytes bytes, padded out in its text
+    static std::string tweetJson(std::uint64_t id, std::size_t bytes) {
+        std::string json = "{\"id\":" + std::to_string(id) + ",\"text\":\"";
+        std::size_t closing = 2;
+        if (bytes > json.size() + closing) {
+            json.append(bytes - json.size() - closing, 'x');
+        }
+        return json + "\"}";
+    }
+
+    static std::string_view trim(std::string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+            text.remove_prefix(1);
+        }
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    static std::string lower(std::string_view text) {
+        std::string result(text);
+        for (char& c : result) {
+            if (c >= 'A' && c <= 'Z') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+// Bounded lock-free multi-producer, single-consumer ring buffer.
+//
+// Each cell carries a sequence number (Vyukov's bounded queue): producers claim a position
+// with a CAS on the enqueue counter and publish the cell by bumping its sequence, so they
+// never wait on each other or on the consumer. Pushing fails instead of blocking when the
+// ring is full; what to do then is up to the caller.
+template<typename T>
+class MpscRing {
+public:
+    explicit MpscRing(std::size_t capacity) {
+        if (capacity < 2) {
+            throw std::invalid_argument("MpscRing capacity must be at least 2");
+        }
+        std::size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        mask_ = rounded - 1;
+        cells_ = std::make_unique<Cell[]>(rounded);
+        for (std::size_t i = 0; i < rounded; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+
+    // Claim a slot and let fill write the value in place. Safe to call from any thread.
+    template<typename Fill>
+    bool tryEmplace(Fill&& fill) {
+        std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        fill(cell->value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Claim count consecutive slots with one CAS, for a value too big for one slot, and let
+    // fill(slot, index) write each in place. The first slot is published last, so a consumer
+    // that sees it can take the other count - 1 right after it. Fails if they are not all free.
+    template<typename Fill>
+    bool tryEmplaceRun(std::size_t count, Fill&& fill) {
+        if (count == 0 || count > capacity()) {
+            return false;
+        }
+        std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            std::size_t sequence = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                // The consumer frees slots in order, so if the last one is free so are the rest
+                std::size_t last = pos + count - 1;
+                std::size_t lastSequence = cells_[last & mask_].sequence.load(std::memory_order_acquire);
+                if (static_cast<std::intptr_t>(lastSequence) - static_cast<std::intptr_t>(last) < 0) {
+                    return false;
+                }
+                if (enqueuePos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        for (std::size_t i = count; i-- > 0;) {
+            Cell& cell = cells_[(pos + i) & mask_];
+            fill(cell.value, i);
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    bool tryPush(const T& value) {
+        return tryEmplace([&value](T& slot) { slot = value; });
+    }
+
+    // Hand the oldest value to consume without copying it out. Consumer thread only.
+    template<typename Consume>
+    bool tryConsume(Consume&& consume) {
+        std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1) < 0) {
+            return false;
+        }
+        consume(cell.value);
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        dequeuePos_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // The oldest value, left in place, or null if there is none. Consumer thread only.
+    const T* peek() const {
+        std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        const Cell& cell = cells_[pos & mask_];
+        std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1) < 0) {
+            return nullptr;
+        }
+        return &cell.value;
+    }
+
+    bool tryPop(T& out) {
+        return tryConsume([&out](T& value) { out = std::move(value); });
+    }
+
+    // How many positions producers have claimed so far. Everything claimed before the call has
+    // been consumed once dequeued() reaches the returned value.
+    std::size_t enqueued() const { return enqueuePos_.load(std::memory_order_relaxed); }
+
+    // How many values have been consumed. Consumer thread only.
+    std::size_t dequeued() const { return dequeuePos_.load(std::memory_order_relaxed); }
+
+    // Approximate number of queued values; exact only when producers are quiescent
+    std::size_t sizeApprox() const {
+        std::size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+        std::size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    static constexpr std::size_t kCacheLine = 64;
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_ = 0;
+    alignas(kCacheLine) std::atomic<std::size_t> enqueuePos_{0};
+    alignas(kCacheLine) std::atomic<std::size_t> dequeuePos_{0}; // written by the consumer only
+};
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// An unencoded request parameter to sign, e.g. a form field of the body
+struct OAuthParameter {
+    std::string_view key;
+    std::string_view value;
+};
+
+// A signed "Authorization: OAuth ..." header line, ready for curl_slist_append
+struct OAuthHeader {
+    static constexpr std::size_t kCapacity = 1024;
+
+    char data[kCapacity];
+    std::size_t length = 0;
+
+    const char* c_str() const { return data; }
+    std::string_view view() const { return std::string_view(data, length); }
+};
+
+// SHA-1 (FIPS 180-4), enough for HMAC-SHA1 without going through OpenSSL's heap-allocated
+// contexts. A Sha1 is a plain value, so a state part-way through a message can be copied.
+class Sha1 {
+public:
+    static constexpr std::size_t kDigestBytes = 20;
+    static constexpr std::size_t kBlockBytes = 64;
+
+    void update(const void* data, std::size_t size) {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        length_ += size;
+        if (buffered_ > 0) {
+            std::size_t take = std::min(size, kBlockBytes - buffered_);
+            std::memcpy(buffer_ + buffered_, bytes, take);
+            buffered_ += take;
+            bytes += take;
+            size -= take;
+            if (buffered_ < kBlockBytes) {
+                return;
+            }
+            compress(buffer_);
+            buffered_ = 0;
+        }
+        for (; size >= kBlockBytes; bytes += kBlockBytes, size -= kBlockBytes) {
+            compress(bytes);
+        }
+        std::memcpy(buffer_, bytes, size);
+        buffered_ = size;
+    }
+
+    void update(std::string_view text) { update(text.data(), text.size()); }
+
+    void finish(std::uint8_t (&digest)[kDigestBytes]) {
+        std::uint64_t bits = length_ * 8;
+        std::uint8_t padding[kBlockBytes * 2] = {0x80};
+        std::size_t padBytes = (buffered_ < 56 ? 56 : 120) - buffered_;
+        for (int i = 0; i < 8; ++i) {
+            padding[padBytes + i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(padding, padBytes + 8);
+        for (int i = 0; i < 5; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                digest[i * 4 + j] = static_cast<std::uint8_t>(state_[i] >> (24 - 8 * j));
+            }
+        }
+    }
+
+private:
+    std::uint32_t state_[5] = {0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u, 0xC3D2E1F0u};
+    std::uint8_t buffer_[kBlockBytes] = {};
+    std::size_t buffered_ = 0;
+    std::uint64_t length_ = 0;
+
+    static std::uint32_t rotate(std::uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    void compress(const std::uint8_t* block) {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (std::uint32_t(block[i * 4]) << 24) | (std::uint32_t(block[i * 4 + 1]) << 16) |
+                   (std::uint32_t(block[i * 4 + 2]) << 8) | std::uint32_t(block[i * 4 + 3]);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        std::uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4];
+        for (int i = 0; i < 80; ++i) {
+            std::uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999u;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1u;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDCu;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6u;
+            }
+            std::uint32_t next = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = next;
+        }
+        state_[0] += a;
+        state_[1] += b;
+        state_[2] += c;
+        state_[3] += d;
+        state_[4] += e;
+    }
+};
+
+// Signs requests with OAuth 1.0a HMAC-SHA1 (RFC 5849) for one set of consumer and token
+// credentials. Signing allocates nothing: parameters are percent-encoded through a lookup
+// table into a stack arena and sorted in place, the signature base string is streamed into
+// the hash instead of being built, the HMAC key pads are hashed once up front, and the header
+// is written into an OAuthHeader. Query parameters in the URL are signed too. Safe to use
+// from several threads at once.
+class OAuthSigner {
+public:
+    static constexpr std::size_t kMaxParameters = 32;  // including the six oauth_ ones
+    static constexpr std::size_t kArenaBytes = 8192;   // encoded keys and values of one request
+
+    OAuthSigner(std::string_view consumerKey, std::string_view consumerSecret, std::string_view token, std::string_view tokenSecret) {
+        appendEncoded(consumerKey, consumerKey_);
+        appendEncoded(token, token_);
+
+        std::string key;
+        appendEncoded(consumerSecret, key);
+        key += '&';
+        appendEncoded(tokenSecret, key);
+        std::uint8_t block[Sha1::kBlockBytes] = {};
+        if (key.size() > Sha1::kBlockBytes) {
+            Sha1 hash;
+            hash.update(key);
+            std::uint8_t digest[Sha1::kDigestBytes];
+            hash.finish(digest);
+            std::memcpy(block, digest, sizeof(digest));
+        } else {
+            std::memcpy(block, key.data(), key.size());
+        }
+        std::uint8_t pad[Sha1::kBlockBytes];
+        for (std::size_t i = 0; i < Sha1::kBlockBytes; ++i) {
+            pad[i] = block[i] ^ 0x36;
+        }
+        inner_.update(pad, sizeof(pad));
+        for (std::size_t i = 0; i < Sha1::kBlockBytes; ++i) {
+            pad[i] = block[i] ^ 0x5c;
+        }
+        outer_.update(pad, sizeof(pad));
+    }
+
+    // Sign a request to url with the given body parameters, using the current time and a
+    // random nonce. Throws std::runtime_error if the parameters do not fit kMaxParameters or
+    // kArenaBytes, or the header does not fit an OAuthHeader.
+    void sign(std::string_view method, std::string_view url, std::initializer_list<OAuthParameter> parameters,
+              OAuthHeader& header) const {
+        char nonce[16];
+        std::uint64_t random = nextRandom();
+        for (std::size_t i = 0; i < sizeof(nonce); ++i, random >>= 4) {
+            nonce[i] = "0123456789abcdef"[random & 0xf];
+        }
+        char timestamp[24];
+        int length = std::snprintf(timestamp, sizeof(timestamp), "%lld", static_cast<long long>(std::time(nullptr)));
+        sign(method, url, parameters, std::string_view(timestamp, static_cast<std::size_t>(length)),
+             std::string_view(nonce, sizeof(nonce)), header);
+    }
+
+    // As above with a given timestamp and nonce, e.g. to check against a known signature
+    void sign(std::string_view method, std::string_view url, std::initializer_list<OAuthParameter> parameters,
+              std::string_view timestamp, std::string_view nonce, OAuthHeader& header) const {
+        Arena arena;
+        std::size_t query = url.find('?');
+        std::string_view baseUrl = url.substr(0, std::min(url.find('#'), query));
+        if (query != std::string_view::npos) {
+            addQuery(arena, url.substr(query + 1, url.find('#') - query - 1));
+        }
+        for (const OAuthParameter& parameter : parameters) {
+            arena.add(parameter.key, parameter.value);
+        }
+        arena.addEncoded("oauth_consumer_key", consumerKey_);
+        arena.add("oauth_nonce", nonce);
+        arena.addEncoded("oauth_signature_method", "HMAC-SHA1");
+        arena.add("oauth_timestamp", timestamp);
+        arena.addEncoded("oauth_token", token_);
+        arena.addEncoded("oauth_version", "1.0");
+        arena.sort();
+
+        // Signature base string: METHOD&encode(base url)&encode(k=v&k=v...)
+        Sha1 hash = inner_;
+        hash.update(method);
+        hash.update("&", 1);
+        updateEncoded(hash, baseUrl);
+        hash.update("&", 1);
+        for (std::size_t i = 0; i < arena.count; ++i) {
+            if (i > 0) {
+                hash.update("%26", 3);
+            }
+            updateEncoded(hash, arena.key(i));
+            hash.update("%3D", 3);
+            updateEncoded(hash, arena.value(i));
+        }
+        std::uint8_t digest[Sha1::kDigestBytes];
+        hash.finish(digest);
+        Sha1 outer = outer_;
+        outer.update(digest, sizeof(digest));
+        outer.finish(digest);
+
+        char signature[28];
+        base64(digest, signature);
+
+        HeaderWriter out{header};
+        out.append("Authorization: OAuth oauth_consumer_key=\"");
+        out.append(consumerKey_);
+        out.append("\", oauth_nonce=\"");
+        out.appendEncoded(nonce);
+        out.append("\", oauth_signature=\"");
+        out.appendEncoded(std::string_view(signature, sizeof(signature)));
+        out.append("\", oauth_signature_method=\"HMAC-SHA1\", oauth_timestamp=\"");
+        out.appendEncoded(timestamp);
+        out.append("\", oauth_token=\"");
+        out.append(token_);
+        out.append("\", oauth_version=\"1.0\"");
+        out.finish();
+    }
+
+    // RFC 3986 percent-encoding, as OAuth wants it: everything but A-Z a-z 0-9 - . _ ~
+    static void appendEncoded(std::string_view text, std::string& out) {
+        for (unsigned char c : text) {
+            if (kUnreserved[c]) {
+                out += static_cast<char>(c);
+            } else {
+                out += '%';
+                out += kHex[c >> 4];
+                out += kHex[c & 0xf];
+            }
+        }
+    }
+
+private:
+    static constexpr char kHex[] = "0123456789ABCDEF";
+    static constexpr std::array<bool, 256> kUnreserved = []() {
+        std::array<bool, 256> table{};
+        for (int c = 0; c < 256; ++c) {
+            table[c] = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                       c == '-' || c == '.' || c == '_' || c == '~';
+        }
+        return table;
+    }();
+
+    std::string consumerKey_; // encoded
+    std::string token_;       // encoded
+    Sha1 inner_;              // after the key ^ ipad block
+    Sha1 outer_;              // after the key ^ opad block
+
+    // Encoded parameters of one request, stored back to back, with their (key, value) offsets
+    struct Arena {
+        char data[kArenaBytes];
+        std::size_t used = 0;
+        struct Entry {
+            std::uint16_t key, keyLength, value, valueLength;
+        } entries[kMaxParameters];
+        std::size_t count = 0;
+
+        std::string_view key(std::size_t i) const { return std::string_view(data + entries[i].key, entries[i].keyLength); }
+        std::string_view value(std::size_t i) const { return std::string_view(data + entries[i].value, entries[i].valueLength); }
+
+        void add(std::string_view key, std::string_view value) {
+            Entry& entry = next();
+            entry.key = static_cast<std::uint16_t>(used);
+            encode(key, false);
+            entry.keyLength = static_cast<std::uint16_t>(used - entry.key);
+            entry.value = static_cast<std::uint16_t>(used);
+            encode(value, false);
+            entry.valueLength = static_cast<std::uint16_t>(used - entry.value);
+        }
+
+        // Adds a pair that is already encoded
+        void addEncoded(std::string_view key, std::string_view value) {
+            Entry& entry = next();
+            entry.key = static_cast<std::uint16_t>(used);
+            copy(key);
+            entry.keyLength = static_cast<std::uint16_t>(key.size());
+            entry.value = static_cast<std::uint16_t>(used);
+            copy(value);
+            entry.valueLength = static_cast<std::uint16_t>(value.size());
+        }
+
+        // Adds a pair taken from a query string, decoding it first so it is encoded the
+        // same way as everything else
+        void addFromQuery(std::string_view key, std::string_view value) {
+            Entry& entry = next();
+            entry.key = static_cast<std::uint16_t>(used);
+            encode(key, true);
+            entry.keyLength = static_cast<std::uint16_t>(used - entry.key);
+            entry.value = static_cast<std::uint16_t>(used);
+            encode(value, true);
+            entry.valueLength = static_cast<std::uint16_t>(used - entry.value);
+        }
+
+        // By key, then value, comparing encoded bytes; insertion sort, as requests carry few
+        void sort() {
+            for (std::size_t i = 1; i < count; ++i) {
+                Entry entry = entries[i];
+                std::size_t j = i;
+                while (j > 0 && less(entry, entries[j - 1])) {
+                    entries[j] = entries[j - 1];
+                    --j;
+                }
+                entries[j] = entry;
+            }
+        }
+
+    private:
+        Entry& next() {
+            if (count == kMaxParameters) {
+                throw std::runtime_error("Too many OAuth parameters");
+            }
+            return entries[count++];
+        }
+
+        bool less(const Entry& a, const Entry& b) const {
+            std::string_view aKey(data + a.key, a.keyLength), bKey(data + b.key, b.keyLength);
+            if (aKey != bKey) {
+                return aKey < bKey;
+            }
+            return std::string_view(data + a.value, a.valueLength) < std::string_view(data + b.value, b.valueLength);
+        }
+
+        void reserve(std::size_t bytes) {
+            if (used + bytes > kArenaBytes) {
+                throw std::runtime_error("OAuth parameters too long to sign");
+            }
+        }
+
+        void copy(std::string_view text) {
+            reserve(text.size());
+            std::memcpy(data + used, text.data(), text.size());
+            used += text.size();
+        }
+
+        void encode(std::string_view text, bool decodeFirst) {
+            for (std::size_t i = 0; i < text.size(); ++i) {
+                unsigned char c = static_cast<unsigned char>(text[i]);
+                if (decodeFirst) {
+                    if (c == '+') {
+                        c = ' ';
+                    } else if (c == '%' && i + 2 < text.size() && isHex(text[i + 1]) && isHex(text[i + 2])) {
+                        c = static_cast<unsigned char>(hexValue(text[i + 1]) << 4 | hexValue(text[i + 2]));
+                        i += 2;
+                    }
+                }
+                if (kUnreserved[c]) {
+                    reserve(1);
+                    data[used++] = static_cast<char>(c);
+                } else {
+                    reserve(3);
+                    data[used++] = '%';
+                    data[used++] = kHex[c >> 4];
+                    data[used++] = kHex[c & 0xf];
+                }
+            }
+        }
+
+        static bool isHex(char c) {
+            return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+        }
+
+        static int hexValue(char c) {
+            return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+        }
+    };
+
+    struct HeaderWriter {
+        OAuthHeader& header;
+        std::size_t length = 0;
+
+        void append(std::string_view text) {
+            if (length + text.size() >= OAuthHeader::kCapacity) {
+                throw std::runtime_error("OAuth header too long");
+            }
+            std::memcpy(header.data + length, text.data(), text.size());
+            length += text.size();
+        }
+
+        void appendEncoded(std::string_view text) {
+            for (unsigned char c : text) {
+                if (kUnreserved[c]) {
+                    append(std::string_view(reinterpret_cast<const char*>(&c), 1));
+                } else {
+                    char escaped[3] = {'%', kHex[c >> 4], kHex[c & 0xf]};
+                    append(std::string_view(escaped, 3));
+                }
+            }
+        }
+
+        void finish() {
+            header.data[length] = '\0';
+            header.length = length;
+        }
+    };
+
+    static void addQuery(Arena& arena, std::string_view query) {
+        while (!query.empty()) {
+            std::size_t amp = query.find('&');
+            std::string_view pair = query.substr(0, amp);
+            query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+            if (pair.empty()) {
+                continue;
+            }
+            std::size_t equals = pair.find('=');
+            arena.addFromQuery(pair.substr(0, equals), equals == std::string_view::npos ? std::string_view() : pair.substr(equals + 1));
+        }
+    }
+
+    // Feeds the percent-encoding of text to hash, a buffer at a time
+    static void updateEncoded(Sha1& hash, std::string_view text) {
+        char buffer[192];
+        std::size_t used = 0;
+        for (unsigned char c : text) {
+            if (used > sizeof(buffer) - 3) {
+                hash.update(buffer, used);
+                used = 0;
+            }
+            if (kUnreserved[c]) {
+                buffer[used++] = static_cast<char>(c);
+            } else {
+                buffer[used++] = '%';
+                buffer[used++] = kHex[c >> 4];
+                buffer[used++] = kHex[c & 0xf];
+            }
+        }
+        hash.update(buffer, used);
+    }
+
+    static void base64(const std::uint8_t (&digest)[Sha1::kDigestBytes], char (&out)[28]) {
+        static constexpr char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::size_t o = 0;
+        for (std::size_t i = 0; i < 18; i += 3) {
+            std::uint32_t triple = std::uint32_t(digest[i]) << 16 | std::uint32_t(digest[i + 1]) << 8 | digest[i + 2];
+            out[o++] = kAlphabet[triple >> 18 & 63];
+            out[o++] = kAlphabet[triple >> 12 & 63];
+            out[o++] = kAlphabet[triple >> 6 & 63];
+            out[o++] = kAlphabet[triple & 63];
+        }
+        std::uint32_t last = std::uint32_t(digest[18]) << 16 | std::uint32_t(digest[19]) << 8;
+        out[o++] = kAlphabet[last >> 18 & 63];
+        out[o++] = kAlphabet[last >> 12 & 63];
+        out[o++] = kAlphabet[last >> 6 & 63];
+        out[o++] = '=';
+    }
+
+    // Per-thread generator for nonces, seeded once from std::random_device
+    static std::uint64_t nextRandom() {
+        thread_local std::mt19937_64 generator(std::random_device{}());
+        return generator();
+    }
+};
@@ -6,15 +6,13 @@
 #include <memory>
 #include <stdexcept>
 #include <sqlite3.h>
+#include "../StartupProfile.h"
+#include "../ThreadPool.h"
 
-// Database connection class
+// Database connection class. The database is opened on first use rather than on construction.
 class DatabaseConnection {
 public:
-    DatabaseConnection(const std::string& db_name) {
-        if (sqlite3_open(db_name.c_str(), &db_) != SQLITE_OK) {
-            throw std::runtime_error("Could not open database");
-        }
-    }
+    DatabaseConnection(const std::string& db_name) : db_name_(db_name) {}
 
     ~DatabaseConnection() {
         if (db_) {
@@ -22,10 +20,24 @@ public:
         }
     }
 
-    sqlite3* get() const { return db_; }
+    sqlite3* get() const {
+        std::call_once(opened_, [this]() {
+            StartupProfile::instance().measure("db.connection", [this]() {
+                sqlite3* db = nullptr;
+                if (sqlite3_open(db_name_.c_str(), &db) != SQLITE_OK) {
+                    sqlite3_close(db);
+                    throw std::runtime_error("Could not open database");
+                }
+                db_ = db;
+            });
+        });
+        return db_;
+    }
 
 private:
-    sqlite3* db_;
+    std::string db_name_;
+    mutable sqlite3* db_ = nullptr;
+    mutable std::once_flag opened_;
 };
 
 // Class to manage database operations
@@ -109,18 +121,19 @@ int main() {
         std::shared_ptr<DatabaseConnection> connection = std::make_shared<DatabaseConnection>("virtual_engine.db");
         DatabaseManager dbManager(connection);
 
-        std::vector<std::thread> threads;
+        std::vector<std::future<void>> tasks;
         for (int i = 0; i < 3; ++i) {
-            threads.emplace_back(simulateDbOperations, std::ref(dbManager));
+            tasks.push_back(ThreadPool::shared().submit(simulateDbOperations, std::ref(dbManager)));
         }
 
-        for (auto& thread : threads) {
-            thread.join();
+        for (auto& task : tasks) {
+            task.get();
         }
     } catch (const std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
         return 1;
     }
 
+    StartupProfile::instance().print(std::cout);
     return 0;
 }
\ No newline at end of file
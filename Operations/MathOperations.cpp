@@ -7,6 +7,7 @@
    #include <numeric>
    #include <future>
    #include <cmath>
+   #include "../ThreadPool.h"
 
    // A class representing a complex mathematical operation
    class ComplexOperation {
@@ -50,15 +51,15 @@
        return list;
    }
 
-   // Function to execute a list of threads
+   // Function to run a task several times at once on the shared pool
    template<typename Func>
-   void executeInThreads(Func func, int threadCount) {
-       std::vector<std::thread> threads;
-       for (int i = 0; i < threadCount; ++i) {
-           threads.emplace_back(func);
+   void executeInParallel(Func func, int taskCount) {
+       std::vector<std::future<void>> tasks;
+       for (int i = 0; i < taskCount; ++i) {
+           tasks.push_back(ThreadPool::shared().submit(func));
        }
-       for (auto& thread : threads) {
-           thread.join();
+       for (auto& task : tasks) {
+           task.get();
        }
    }
 
@@ -66,8 +67,8 @@
        // Create a list of complex operations
        auto operations = createComplexOperationsList(10);
 
-       // Execute all operations in separate threads
-       executeInThreads([&]() {
+       // Execute all operations in parallel
+       executeInParallel([&]() {
            for (auto& operation : operations) {
                operation->performOperation();
            }
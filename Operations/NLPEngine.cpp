@@ -8,26 +8,62 @@
 #include <mutex>
 #include <thread>
 #include <shared_mutex>
+#include <memory>
+#include <string_view>
+#include "../QaCorpusFile.h"
+#include "../StartupProfile.h"
+#include "../ThreadPool.h"
 
 // A class to manage text-related operations
 class NlpEngine {
 public:
-    NlpEngine() {
-        loadPredefinedAnswers();
+    // Predefined answers are loaded on first use, not here, to keep construction cheap
+    NlpEngine() = default;
+
+    // Load the predefined answers now instead of on the first question
+    void warmUp() {
+        std::call_once(loaded_, [this]() {
+            StartupProfile::instance().measure("nlp.tables", [this]() {
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                loadPredefinedAnswers();
+            });
+        });
     }
 
     std::string answerQuestion(const std::string& question) {
+        warmUp();
         std::shared_lock<std::shared_mutex> lock(mutex_);
         auto tokens = tokenize(question);
         std::string loweredQuestion = toLowerCase(question);
-        if (predefined_answers.find(loweredQuestion) != predefined_answers.end()) {
-            return predefined_answers[loweredQuestion];
-        } else {
-            return "I'm not sure about that.";
+        auto it = predefined_answers.find(loweredQuestion);
+        if (it != predefined_answers.end()) {
+            return it->second;
+        }
+        if (auto answer = corpusAnswer(loweredQuestion); !answer.empty()) {
+            return std::string(answer);
+        }
+        return "I'm not sure about that.";
+    }
+
+    // Zero-copy lookup in the loaded corpus file; empty if there is no corpus or no match.
+    // The view stays valid for the lifetime of the engine.
+    std::string_view findCorpusAnswer(const std::string& question) {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return corpusAnswer(toLowerCase(question));
+    }
+
+    // Map a corpus file built by QaCorpusBuilder; answers are served straight from the mapping
+    void loadCorpus(const std::string& path) {
+        auto corpus = std::make_unique<QaCorpusFile>(path);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (corpus_) {
+            throw std::logic_error("A corpus is already loaded");
         }
+        corpus_ = std::move(corpus);
     }
 
     void addPredefinedAnswer(const std::string& question, const std::string& answer) {
+        warmUp();
         std::unique_lock<std::shared_mutex> lock(mutex_);
         predefined_answers[toLowerCase(question)] = answer;
     }
@@ -51,6 +87,14 @@ private:
         return lower_str;
     }
 
+    std::string_view corpusAnswer(std::string_view loweredQuestion) const {
+        if (!corpus_) {
+            return {};
+        }
+        auto index = corpus_->find(loweredQuestion);
+        return index ? corpus_->answer(*index) : std::string_view();
+    }
+
     void loadPredefinedAnswers() {
         predefined_answers["hello"] = "Hi there!";
         predefined_answers["how are you?"] = "I'm a bot, so I don't have feelings, but thanks for asking!";
@@ -59,6 +103,8 @@ private:
     }
 
     std::unordered_map<std::string, std::string> predefined_answers;
+    std::unique_ptr<QaCorpusFile> corpus_;
+    std::once_flag loaded_;
     std::shared_mutex mutex_;
 };
 
@@ -70,9 +116,21 @@ void simulateBotInteraction(NlpEngine& nlpEngine, const std::vector<std::string>
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     NlpEngine nlpEngine;
 
+    // Optionally serve answers from a binary corpus file
+    if (argc > 1) {
+        try {
+            StartupProfile::instance().measure("nlp.corpus", [&]() {
+                nlpEngine.loadCorpus(argv[1]);
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "Exception: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     // Add more predefined answers
     nlpEngine.addPredefinedAnswer("what is the capital of france?", "The capital of France is Paris.");
     nlpEngine.addPredefinedAnswer("tell me a joke", "Why don't scientists trust atoms? Because they make up everything!");
@@ -89,14 +147,15 @@ int main() {
     };
 
     // Simulate the bot interaction in multiple threads
-    std::vector<std::thread> threads;
+    std::vector<std::future<void>> tasks;
     for (int i = 0; i < 3; ++i) {
-        threads.emplace_back(simulateBotInteraction, std::ref(nlpEngine), std::ref(questions));
+        tasks.push_back(ThreadPool::shared().submit(simulateBotInteraction, std::ref(nlpEngine), std::ref(questions)));
     }
 
-    for (auto& thread : threads) {
-        thread.join();
+    for (auto& task : tasks) {
+        task.get();
     }
 
+    StartupProfile::instance().print(std::cout);
     return 0;
 }
\ No newline at end of file
@@ -2,12 +2,15 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 #include <sstream>
 #include <cctype>
 #include <mutex>
 #include <thread>
 #include <shared_mutex>
+#include "../StartupProfile.h"
+#include "../ThreadPool.h"
 
 // Enumeration for question types
 enum class QuestionType {
@@ -20,11 +23,21 @@ enum class QuestionType {
 // A class to manage question classification
 class QuestionClassifier {
 public:
-    QuestionClassifier() {
-        loadKeywords();
+    // Keyword tables are loaded on first use, not here, to keep construction cheap
+    QuestionClassifier() = default;
+
+    // Load the keyword tables now instead of on the first question
+    void warmUp() {
+        std::call_once(loaded_, [this]() {
+            StartupProfile::instance().measure("classifier.keywords", [this]() {
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                loadKeywords();
+            });
+        });
     }
 
     QuestionType classifyQuestion(const std::string& question) {
+        warmUp();
         std::shared_lock<std::shared_mutex> lock(mutex_);
         std::string loweredQuestion = toLowerCase(question);
         auto tokens = tokenize(loweredQuestion);
@@ -82,6 +95,7 @@ private:
     std::unordered_set<std::string> greeting_keywords;
     std::unordered_set<std::string> information_keywords;
     std::unordered_set<std::string> joke_keywords;
+    std::once_flag loaded_;
     std::shared_mutex mutex_;
 };
 
@@ -106,14 +120,15 @@ int main() {
     };
 
     // Simulate the question classification in multiple threads
-    std::vector<std::thread> threads;
+    std::vector<std::future<void>> tasks;
     for (int i = 0; i < 3; ++i) {
-        threads.emplace_back(simulateQuestionClassification, std::ref(classifier), std::ref(questions));
+        tasks.push_back(ThreadPool::shared().submit(simulateQuestionClassification, std::ref(classifier), std::ref(questions)));
     }
 
-    for (auto& thread : threads) {
-        thread.join();
+    for (auto& task : tasks) {
+        task.get();
     }
 
+    StartupProfile::instance().print(std::cout);
     return 0;
 }
\ No newline at end of file
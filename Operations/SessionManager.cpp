@@ -9,6 +9,9 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include "../ThreadPool.h"
+#include "../TimestampCache.h"
 
 // Class to handle individual user sessions
 class Session {
@@ -39,10 +42,7 @@ private:
     bool sessionActive_ = true;
 
     std::string formatTime(std::chrono::system_clock::time_point timePoint) const {
-        std::time_t time = std::chrono::system_clock::to_time_t(timePoint);
-        std::ostringstream oss;
-        oss << std::put_time(std::localtime(&time), "%Y-%m-%d %X");
-        return oss.str();
+        return TimestampCache::toString(timePoint);
     }
 };
 
@@ -110,13 +110,13 @@ int main() {
     };
 
     // Simulate session management in multiple threads
-    std::vector<std::thread> threads;
+    std::vector<std::future<void>> tasks;
     for (int i = 0; i < 3; ++i) {
-        threads.emplace_back(simulateSessionManagement, std::ref(sessionManager), std::ref(userIds));
+        tasks.push_back(ThreadPool::shared().submit(simulateSessionManagement, std::ref(sessionManager), std::ref(userIds)));
     }
 
-    for (auto& thread : threads) {
-        thread.join();
+    for (auto& task : tasks) {
+        task.get();
     }
 
     return 0;
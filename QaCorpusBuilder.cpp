@@ -0,0 +1,50 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "QaCorpusFile.h"
+
+// Builds a binary corpus file from tab-separated "question<TAB>answer" lines.
+// Blank lines and lines starting with '#' are skipped.
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.tsv> <output.qac>" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::ifstream input(argv[1]);
+        if (!input.is_open()) {
+            throw std::runtime_error(std::string("Could not open ") + argv[1]);
+        }
+
+        QaCorpusWriter writer;
+        std::string line;
+        std::size_t lineNumber = 0;
+        while (std::getline(input, line)) {
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            auto tab = line.find('\t');
+            if (tab == std::string::npos) {
+                std::cerr << "Skipping line " << lineNumber << ": no tab separator" << std::endl;
+                continue;
+            }
+            writer.add(std::string_view(line).substr(0, tab), std::string_view(line).substr(tab + 1));
+        }
+
+        std::size_t added = writer.size();
+        writer.write(argv[2]);
+        QaCorpusFile corpus(argv[2]);
+        std::cout << "Wrote " << corpus.size() << " entries (" << added - corpus.size()
+                  << " duplicates dropped) to " << argv[2] << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// On-disk question/answer corpus.
+//
+// Layout (native little-endian):
+//   QaCorpusHeader
+//   QaCorpusEntry[entryCount]   sorted by normalized question, so lookups binary search in place
+//   string blob                 question, answer and normalized key bytes, not NUL-terminated
+//
+// All offsets in entries are relative to the start of the blob.
+
+struct QaCorpusHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t entryCount;
+    std::uint64_t entriesOffset;
+    std::uint64_t blobOffset;
+    std::uint64_t blobSize;
+};
+
+struct QaCorpusEntry {
+    std::uint64_t questionOffset;
+    std::uint64_t answerOffset;
+    std::uint64_t keyOffset;
+    std::uint32_t questionLength;
+    std::uint32_t answerLength;
+    std::uint32_t keyLength;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(QaCorpusHeader) == 48, "QaCorpusHeader layout is part of the file format");
+static_assert(sizeof(QaCorpusEntry) == 40, "QaCorpusEntry layout is part of the file format");
+
+constexpr char kQaCorpusMagic[8] = {'V', 'E', 'Q', 'A', 'C', 'R', 'P', '1'};
+constexpr std::uint32_t kQaCorpusVersion = 1;
+
+// Lookup key for a question: ASCII lowercase, the same normalization NlpEngine uses
+inline std::string normalizeQuestion(std::string_view question) {
+    std::string key(question);
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) {
+        return std::tolower(c);
+    });
+    return key;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open " + path);
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            data_ = mapping_ ? static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (!data_) {
+                close();
+                throw std::runtime_error("Could not map " + path);
+            }
+        }
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open " + path);
+        }
+        struct stat st {};
+        if (::fstat(fd_, &st) != 0) {
+            close();
+            throw std::runtime_error("Could not stat " + path);
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (data == MAP_FAILED) {
+                close();
+                throw std::runtime_error("Could not map " + path);
+            }
+            data_ = static_cast<const char*>(data);
+        }
+#endif
+    }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+
+    void close() {
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        data_ = nullptr;
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    int fd_ = -1;
+
+    void close() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        data_ = nullptr;
+        fd_ = -1;
+    }
+#endif
+};
+
+// A corpus file mapped into memory. Questions and answers are handed out as views into
+// the mapping, so nothing is copied onto the heap and pages load on first touch.
+class QaCorpusFile {
+public:
+    explicit QaCorpusFile(const std::string& path) : file_(path) {
+        if (file_.size() < sizeof(QaCorpusHeader)) {
+            throw std::runtime_error("Corpus file too small: " + path);
+        }
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, kQaCorpusMagic, sizeof(kQaCorpusMagic)) != 0) {
+            throw std::runtime_error("Not a corpus file: " + path);
+        }
+        if (header_.version != kQaCorpusVersion) {
+            throw std::runtime_error("Unsupported corpus version in " + path);
+        }
+        // Checked by subtraction and division, so huge offsets or counts cannot wrap around
+        std::uint64_t fileSize = file_.size();
+        if (header_.entriesOffset % alignof(QaCorpusEntry) != 0 || header_.entriesOffset > fileSize ||
+            header_.entryCount > (fileSize - header_.entriesOffset) / sizeof(QaCorpusEntry) ||
+            header_.blobOffset < header_.entriesOffset + header_.entryCount * sizeof(QaCorpusEntry) ||
+            header_.blobOffset > fileSize || header_.blobSize > fileSize - header_.blobOffset) {
+            throw std::runtime_error("Corrupt corpus file: " + path);
+        }
+        entries_ = reinterpret_cast<const QaCorpusEntry*>(file_.data() + header_.entriesOffset);
+        blob_ = file_.data() + header_.blobOffset;
+    }
+
+    std::size_t size() const { return static_cast<std::size_t>(header_.entryCount); }
+
+    std::string_view question(std::size_t index) const {
+        const QaCorpusEntry& entry = entries_[index];
+        return view(entry.questionOffset, entry.questionLength);
+    }
+
+    std::string_view answer(std::size_t index) const {
+        const QaCorpusEntry& entry = entries_[index];
+        return view(entry.answerOffset, entry.answerLength);
+    }
+
+    // Find the entry whose normalized question equals key
+    std::optional<std::size_t> find(std::string_view key) const {
+        const QaCorpusEntry* end = entries_ + size();
+        const QaCorpusEntry* it = std::lower_bound(entries_, end, key, [this](const QaCorpusEntry& entry, std::string_view value) {
+            return view(entry.keyOffset, entry.keyLength) < value;
+        });
+        if (it != end && view(it->keyOffset, it->keyLength) == key) {
+            return static_cast<std::size_t>(it - entries_);
+        }
+        return std::nullopt;
+    }
+
+private:
+    MappedFile file_;
+    QaCorpusHeader header_{};
+    const QaCorpusEntry* entries_ = nullptr;
+    const char* blob_ = nullptr;
+
+    std::string_view view(std::uint64_t offset, std::uint32_t length) const {
+        if (offset > header_.blobSize || length > header_.blobSize - offset) {
+            throw std::out_of_range("Corpus entry points outside the string blob");
+        }
+        return std::string_view(blob_ + offset, length);
+    }
+};
+
+// Collects question/answer pairs and writes them out in the corpus file format
+class QaCorpusWriter {
+public:
+    void add(std::string_view question, std::string_view answer) {
+        pairs_.push_back({normalizeQuestion(question), std::string(question), std::string(answer)});
+    }
+
+    std::size_t size() const { return pairs_.size(); }
+
+    // Write the corpus; when a question appears more than once the last answer wins
+    void write(const std::string& path) {
+        std::stable_sort(pairs_.begin(), pairs_.end(), [](const Pair& a, const Pair& b) {
+            return a.key < b.key;
+        });
+        std::vector<Pair> unique;
+        unique.reserve(pairs_.size());
+        for (auto& pair : pairs_) {
+            if (!unique.empty() && unique.back().key == pair.key) {
+                unique.back() = std::move(pair);
+            } else {
+                unique.push_back(std::move(pair));
+            }
+        }
+        pairs_ = std::move(unique);
+
+        std::vector<QaCorpusEntry> entries;
+        entries.reserve(pairs_.size());
+        std::uint64_t blobSize = 0;
+        auto place = [&blobSize](const std::string& text, std::uint64_t& offset, std::uint32_t& length) {
+            if (text.size() > UINT32_MAX) {
+                throw std::length_error("Corpus string longer than 4 GiB");
+            }
+            offset = blobSize;
+            length = static_cast<std::uint32_t>(text.size());
+            blobSize += text.size();
+        };
+        for (const auto& pair : pairs_) {
+            QaCorpusEntry entry{};
+            place(pair.question, entry.questionOffset, entry.questionLength);
+            place(pair.answer, entry.answerOffset, entry.answerLength);
+            if (pair.key == pair.question) {
+                // Already lowercase; share the question bytes
+                entry.keyOffset = entry.questionOffset;
+                entry.keyLength = entry.questionLength;
+            } else {
+                place(pair.key, entry.keyOffset, entry.keyLength);
+            }
+            entries.push_back(entry);
+        }
+
+        QaCorpusHeader header{};
+        std::memcpy(header.magic, kQaCorpusMagic, sizeof(kQaCorpusMagic));
+        header.version = kQaCorpusVersion;
+        header.entryCount = entries.size();
+        header.entriesOffset = sizeof(QaCorpusHeader);
+        header.blobOffset = header.entriesOffset + entries.size() * sizeof(QaCorpusEntry);
+        header.blobSize = blobSize;
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Could not open " + path + " for writing");
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(QaCorpusEntry)));
+        for (const auto& pair : pairs_) {
+            out.write(pair.question.data(), static_cast<std::streamsize>(pair.question.size()));
+            out.write(pair.answer.data(), static_cast<std::streamsize>(pair.answer.size()));
+            if (pair.key != pair.question) {
+                out.write(pair.key.data(), static_cast<std::streamsize>(pair.key.size()));
+            }
+        }
+        if (!out) {
+            throw std::runtime_error("Failed writing corpus to " + path);
+        }
+    }
+
+private:
+    struct Pair {
+        std::string key;
+        std::string question;
+        std::string answer;
+    };
+    std::vector<Pair> pairs_;
+};
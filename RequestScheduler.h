@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "HttpMetrics.h"
+
+// Outbound request classes, most urgent first. A class is only admitted ahead of another on
+// the same endpoint; endpoints have budgets of their own.
+enum class RequestPriority { REPLY, INTERACTIVE, BACKGROUND };
+
+struct RateLimit {
+    double perSecond = 0; // sustained rate; 0 means unlimited
+    double burst = 1;     // requests that may go at once after a quiet spell; at least 1
+};
+
+// Admits outbound requests against per-endpoint token buckets. Requests that find no budget
+// wait in per-priority queues and are admitted by one dispatcher thread the moment a token
+// refills, replies before background polls, instead of being sent early to collect a 429.
+// An endpoint is whatever key the caller rate-limits by, e.g. http::hostKey(url) or an API
+// route; endpoints without a limit of their own use the default limit.
+class RequestScheduler {
+public:
+    static constexpr std::size_t kPriorities = 3;
+
+    // Runs on the dispatcher thread once admitted, or with false if the scheduler shuts down
+    // first, so it should only hand the request off (e.g. to AsyncHttpClient)
+    using Task = std::function<void(bool admitted)>;
+
+    struct Stats {
+        std::array<std::size_t, kPriorities> queued{}; // waiting now, by RequestPriority
+        std::uint64_t admitted = 0;
+        std::uint64_t waitP50Micros = 0;               // time from submission to admission
+        std::uint64_t waitP99Micros = 0;
+        std::uint64_t waitMaxMicros = 0;
+    };
+
+    explicit RequestScheduler(RateLimit defaultLimit = RateLimit()) : defaultLimit_(defaultLimit) {
+        dispatcher_ = std::thread(&RequestScheduler::dispatch, this);
+    }
+
+    // Requests still waiting get their task called with false; blocked acquire() calls throw
+    ~RequestScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        dispatcher_.join();
+    }
+
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    // Set endpoint's budget; a changed budget starts with a full bucket
+    void setLimit(const std::string& endpoint, RateLimit limit) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Bucket& bucket = bucketLocked(endpoint);
+        if (bucket.limit.perSecond == limit.perSecond && bucket.limit.burst == std::max(1.0, limit.burst)) {
+            return;
+        }
+        bucket.limit = limit;
+        bucket.limit.burst = std::max(1.0, limit.burst);
+        bucket.tokens = bucket.limit.burst;
+        cv_.notify_all();
+    }
+
+    // The server asked for a break (429 / 503 with Retry-After): admit nothing to endpoint for
+    // duration, then resume from an empty bucket
+    void pause(const std::string& endpoint, std::chrono::milliseconds duration) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Bucket& bucket = bucketLocked(endpoint);
+        bucket.tokens = 0;
+        bucket.pausedUntil = std::max(bucket.pausedUntil, Clock::now() + duration);
+        bucket.refilled = bucket.pausedUntil;
+    }
+
+    // Queue task for admission
+    void schedule(const std::string& endpoint, RequestPriority priority, Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                throw std::runtime_error("RequestScheduler is shutting down");
+            }
+            Bucket& bucket = bucketLocked(endpoint);
+            bucket.queues[static_cast<std::size_t>(priority)].push_back({std::move(task), Clock::now()});
+            ++queued_[static_cast<std::size_t>(priority)];
+        }
+        cv_.notify_all();
+    }
+
+    // Block the calling thread until a request to endpoint is admitted. Throws
+    // std::runtime_error if the scheduler shuts down first.
+    void acquire(const std::string& endpoint, RequestPriority priority) {
+        std::promise<bool> admitted;
+        std::future<bool> result = admitted.get_future();
+        schedule(endpoint, priority, [&admitted](bool ok) { admitted.set_value(ok); });
+        if (!result.get()) {
+            throw std::runtime_error("RequestScheduler shut down before admitting a request to " + endpoint);
+        }
+    }
+
+    Stats stats() const {
+        Stats stats;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats.queued = queued_;
+        }
+        stats.admitted = waits_.count();
+        stats.waitP50Micros = waits_.percentile(0.5);
+        stats.waitP99Micros = waits_.percentile(0.99);
+        stats.waitMaxMicros = waits_.percentile(1.0);
+        return stats;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        Task task;
+        Clock::time_point submitted;
+    };
+
+    struct Bucket {
+        RateLimit limit;
+        double tokens = 0;
+        Clock::time_point refilled = Clock::now();
+        Clock::time_point pausedUntil = Clock::time_point::min();
+        std::array<std::deque<Waiter>, kPriorities> queues;
+
+        bool waiting() const {
+            return std::any_of(queues.begin(), queues.end(), [](const auto& queue) { return !queue.empty(); });
+        }
+
+        void refill(Clock::time_point now) {
+            if (now <= refilled) {
+                return;
+            }
+            tokens = std::min(limit.burst, tokens + std::chrono::duration<double>(now - refilled).count() * limit.perSecond);
+            refilled = now;
+        }
+
+        // When the next token will be there
+        Clock::time_point nextToken(Clock::time_point now) const {
+            Clock::time_point from = std::max(now, pausedUntil);
+            if (tokens >= 1) {
+                return from;
+            }
+            auto missing = std::chrono::duration<double>((1 - tokens) / limit.perSecond);
+            return std::max(from, refilled + std::chrono::duration_cast<Clock::duration>(missing) + Clock::duration(1));
+        }
+    };
+
+    RateLimit defaultLimit_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Bucket, std::less<>> buckets_;
+    std::array<std::size_t, kPriorities> queued_{};
+    bool stopping_ = false;
+    HdrHistogram waits_;
+    std::thread dispatcher_;
+
+    Bucket& bucketLocked(std::string_view endpoint) {
+        auto found = buckets_.find(endpoint);
+        if (found == buckets_.end()) {
+            found = buckets_.emplace(std::string(endpoint), Bucket()).first;
+            found->second.limit = defaultLimit_;
+            found->second.limit.burst = std::max(1.0, defaultLimit_.burst);
+            found->second.tokens = found->second.limit.burst;
+        }
+        return found->second;
+    }
+
+    void dispatch() {
+        std::vector<Waiter> admitted;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point wake = Clock::time_point::max();
+            for (auto& [endpoint, bucket] : buckets_) {
+                if (!bucket.waiting() || now < bucket.pausedUntil) {
+                    if (bucket.waiting()) {
+                        wake = std::min(wake, bucket.pausedUntil);
+                    }
+                    continue;
+                }
+                bool unlimited = bucket.limit.perSecond <= 0;
+                bucket.refill(now);
+                for (std::size_t priority = 0; priority < kPriorities; ++priority) {
+                    auto& queue = bucket.queues[priority];
+                    while (!queue.empty() && (unlimited || bucket.tokens >= 1)) {
+                        if (!unlimited) {
+                            bucket.tokens -= 1;
+                        }
+                        admitted.push_back(std::move(queue.front()));
+                        queue.pop_front();
+                        --queued_[priority];
+                    }
+                }
+                if (bucket.waiting()) {
+                    wake = std::min(wake, bucket.nextToken(now));
+                }
+            }
+
+            if (!admitted.empty()) {
+                lock.unlock();
+                run(admitted, now);
+                lock.lock();
+                continue;
+            }
+            if (wake == Clock::time_point::max()) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, wake);
+            }
+        }
+
+        for (auto& [endpoint, bucket] : buckets_) {
+            for (auto& queue : bucket.queues) {
+                for (auto& waiter : queue) {
+                    admitted.push_back(std::move(waiter));
+                }
+                queue.clear();
+            }
+        }
+        queued_ = {};
+        lock.unlock();
+        for (auto& waiter : admitted) {
+            invoke(waiter.task, false);
+        }
+    }
+
+    void run(std::vector<Waiter>& admitted, Clock::time_point now) {
+        for (auto& waiter : admitted) {
+            waits_.record(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - waiter.submitted).count()));
+            invoke(waiter.task, true);
+        }
+        admitted.clear();
+    }
+
+    static void invoke(Task& task, bool admitted) {
+        try {
+            task(admitted);
+        } catch (const std::exception& e) {
+            std::cerr << "Scheduled request threw: " << e.what() << std::endl;
+        }
+    }
+};
@@ -0,0 +1,436 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "DataLogCompression.h"
+#include "JsonStream.h"
+#include "OAuthSigner.h"
+
+// ve-selftest: checks the hand-rolled JSON parser, OAuth signer and log block codec against
+// reference results. Exits non-zero and describes the first mismatches on stderr if any check
+// fails; ctest runs it.
+
+using json = nlohmann::json;
+
+// Rebuilds the document JsonStreamParser reports, so it can be compared with nlohmann's
+class JsonBuilder : public JsonHandler {
+public:
+    json root;
+
+    void startObject() override { open(json::object()); }
+    void endObject() override { stack_.pop_back(); }
+    void startArray() override { open(json::array()); }
+    void endArray() override { stack_.pop_back(); }
+    void key(std::string_view key) override { key_.assign(key); }
+
+    void value(JsonType type, std::string_view text) override {
+        switch (type) {
+            case JsonType::STRING: add(std::string(text)); break;
+            case JsonType::NUMBER: add(json::parse(text)); break; // throws if nlohmann disagrees it is a number
+            case JsonType::BOOLEAN: add(text == "true"); break;
+            case JsonType::NONE: add(nullptr); break;
+        }
+    }
+
+private:
+    std::vector<json*> stack_;
+    std::string key_;
+
+    json* add(json value) {
+        if (stack_.empty()) {
+            root = std::move(value);
+            return &root;
+        }
+        json& parent = *stack_.back();
+        if (parent.is_object()) {
+            return &(parent[key_] = std::move(value));
+        }
+        parent.push_back(std::move(value));
+        return &parent.back();
+    }
+
+    void open(json container) { stack_.push_back(add(std::move(container))); }
+};
+
+// What JsonStreamParser made of one document fed in some number of chunks
+struct JsonStreamOutcome {
+    bool valid = false;
+    std::uint64_t consumed = 0; // where it failed, when invalid
+    json value;
+
+    bool operator==(const JsonStreamOutcome& other) const {
+        return valid == other.valid && (valid ? value == other.value : consumed == other.consumed);
+    }
+};
+
+JsonStreamOutcome parseInChunks(std::string_view document, const std::vector<std::size_t>& cuts) {
+    JsonBuilder builder;
+    JsonStreamParser parser(builder);
+    JsonStreamOutcome outcome;
+    try {
+        std::size_t start = 0;
+        bool fed = true;
+        for (std::size_t cut : cuts) {
+            fed = fed && parser.feed(document.substr(start, cut - start));
+            start = cut;
+        }
+        fed = fed && parser.feed(document.substr(start));
+        outcome.valid = fed && parser.finish();
+    } catch (const std::exception&) {
+        outcome.valid = false; // a number nlohmann would not read
+    }
+    outcome.consumed = parser.consumed();
+    outcome.value = std::move(builder.root);
+    return outcome;
+}
+
+// Random documents with the awkward parts of JSON: escapes, \u sequences and surrogate pairs,
+// raw UTF-8, every number form, deep nesting and stray whitespace
+class JsonGenerator {
+public:
+    explicit JsonGenerator(std::uint64_t seed) : random_(seed) {}
+
+    std::string document() {
+        std::string out;
+        space(out);
+        value(out, 0);
+        space(out);
+        return out;
+    }
+
+    // Break a document with a small edit. Only ASCII bytes are touched, so the text stays valid
+    // UTF-8: JsonStreamParser passes raw bytes through unchecked where nlohmann rejects them.
+    void mutate(std::string& text) {
+        static constexpr std::string_view kBytes = "{}[],:\"\\/0123456789.eE+-tfnul \t\n\x01x";
+        std::vector<std::size_t> ascii;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            if (static_cast<unsigned char>(text[i]) < 0x80) {
+                ascii.push_back(i);
+            }
+        }
+        if (ascii.empty()) {
+            return;
+        }
+        std::size_t at = ascii[pick(ascii.size())];
+        switch (pick(4)) {
+            case 0: text.erase(at, 1); break;
+            case 1: text.insert(at, 1, kBytes[pick(kBytes.size())]); break;
+            case 2: text[at] = kBytes[pick(kBytes.size())]; break;
+            case 3: text.resize(at); break;
+        }
+    }
+
+private:
+    std::mt19937_64 random_;
+
+    std::size_t pick(std::size_t count) { return std::uniform_int_distribution<std::size_t>(0, count - 1)(random_); }
+
+    void space(std::string& out) {
+        static constexpr std::string_view kSpace[] = {"", "", "", " ", "\n", "\t ", "\r\n  "};
+        out += kSpace[pick(std::size(kSpace))];
+    }
+
+    void value(std::string& out, int depth) {
+        std::size_t kind = pick(depth > 6 ? 3 : 5);
+        if (kind == 0) {
+            string(out);
+        } else if (kind == 1) {
+            static constexpr std::string_view kNumbers[] = {"0", "-0", "7", "-42", "3.25", "-0.5", "1e9", "2E-3", "6.02e+23",
+                                                            "18446744073709551615", "-9223372036854775808",
+                                                            "123456789012345678901234567890", "1.7976931348623157e308"};
+            out += kNumbers[pick(std::size(kNumbers))];
+        } else if (kind == 2) {
+            static constexpr std::string_view kLiterals[] = {"true", "false", "null"};
+            out += kLiterals[pick(std::size(kLiterals))];
+        } else {
+            bool object = kind == 3;
+            out += object ? '{' : '[';
+            std::size_t count = pick(5);
+            for (std::size_t i = 0; i < count; ++i) {
+                space(out);
+                if (object) {
+                    string(out);
+                    space(out);
+                    out += ':';
+                    space(out);
+                }
+                value(out, depth + 1);
+                space(out);
+                if (i + 1 < count) {
+                    out += ',';
+                }
+            }
+            out += object ? '}' : ']';
+        }
+    }
+
+    void string(std::string& out) {
+        static constexpr std::string_view kPieces[] = {"a", "key", "Tweet text", " ", "\\\"", "\\\\", "\\/", "\\b", "\\f",
+                                                       "\\n", "\\r", "\\t", "\\u0041", "\\u00e9", "\\u20AC", "\\u0000",
+                                                       "\\ud83d\\ude00", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+        out += '"';
+        for (std::size_t count = pick(6); count > 0; --count) {
+            out += kPieces[pick(std::size(kPieces))];
+        }
+        out += '"';
+    }
+};
+
+// Every document is parsed whole, in two chunks split at every offset, and a byte at a time.
+// All of them must agree with each other, and with nlohmann on validity and on the value.
+bool checkJsonStream(std::uint64_t seed, std::size_t documents) {
+    JsonGenerator generator(seed);
+    std::size_t parses = 0;
+    std::size_t failures = 0;
+    auto report = [&failures](const std::string& document, const std::string& what) {
+        if (++failures <= 5) {
+            std::cerr << "json-stream: " << what << " for " << json(document).dump() << std::endl;
+        }
+    };
+
+    for (std::size_t n = 0; n < documents; ++n) {
+        std::string document = generator.document();
+        if (n % 2 == 1) {
+            generator.mutate(document);
+        }
+
+        bool accepted = json::accept(document);
+        JsonStreamOutcome whole = parseInChunks(document, {});
+        ++parses;
+        if (whole.valid != accepted) {
+            report(document, accepted ? "rejected a valid document" : "accepted an invalid document");
+            continue;
+        }
+        if (whole.valid && whole.value != json::parse(document)) {
+            report(document, "parsed to " + whole.value.dump());
+            continue;
+        }
+
+        std::vector<std::size_t> cuts(1);
+        for (std::size_t cut = 0; cut <= document.size(); ++cut) {
+            cuts[0] = cut;
+            ++parses;
+            if (!(parseInChunks(document, cuts) == whole)) {
+                report(document, "split at byte " + std::to_string(cut) + " changed the outcome");
+                break;
+            }
+        }
+        cuts.clear();
+        for (std::size_t cut = 1; cut < document.size(); ++cut) {
+            cuts.push_back(cut);
+        }
+        ++parses;
+        if (!(parseInChunks(document, cuts) == whole)) {
+            report(document, "byte-at-a-time feed changed the outcome");
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << "FAIL json-stream: " << failures << " of " << documents << " documents" << std::endl;
+        return false;
+    }
+    std::cout << "ok json-stream: " << documents << " documents, " << parses << " parses" << std::endl;
+    return true;
+}
+
+// Twitter's worked example from "Creating a signature", signed once with the status as a body
+// parameter and once with it already percent-encoded in the query string
+bool checkOAuthSigner() {
+    static constexpr std::string_view kSignature = "oauth_signature=\"hCtSmYh%2BiHYCEqBWrE7C7hYmtUk%3D\"";
+    static constexpr std::string_view kTimestamp = "1318622958";
+    static constexpr std::string_view kNonce = "kYjzVBB8Y0ZFabxSWbWovY3uYSQ2pTgmZeNu2VS4cg";
+    OAuthSigner signer("xvz1evFS4wEEPTGEFPHBog", "kAcSOqF21Fu85e7zjz7ZN2U4ZRhfV3WpwPAoE3Z7kBw",
+                       "370773112-GmHxMAgYyLbNEtIKZeRNFsMKPR9EyMZeS9weJAEb", "LswwdoUaIvS8ltyTt5jkRh4J50vUPVVHtR2YPi5kE");
+
+    OAuthHeader body;
+    signer.sign("POST", "https://api.twitter.com/1.1/statuses/update.json?include_entities=true",
+                {{"status", "Hello Ladies + Gentlemen, a signed OAuth request!"}}, kTimestamp, kNonce, body);
+    OAuthHeader query;
+    signer.sign("POST", "https://api.twitter.com/1.1/statuses/update.json?include_entities=true"
+                        "&status=Hello+Ladies+%2b+Gentlemen%2C+a+signed+OAuth+request%21",
+                {}, kTimestamp, kNonce, query);
+
+    bool passed = true;
+    if (body.view().find(kSignature) == std::string_view::npos) {
+        std::cerr << "oauth: expected " << kSignature << " in " << body.view() << std::endl;
+        passed = false;
+    }
+    if (query.view() != body.view()) {
+        std::cerr << "oauth: query parameters signed as " << query.view() << std::endl;
+        passed = false;
+    }
+    if (!passed) {
+        std::cerr << "FAIL oauth" << std::endl;
+        return false;
+    }
+    std::cout << "ok oauth: Twitter's HMAC-SHA1 signature" << std::endl;
+    return true;
+}
+
+// Blocks the codec sees in practice and the edge cases of its format: incompressible bytes
+// (stored as they are), long runs and short periods (overlapping matches, match lengths past
+// 15 + 255), log-like text, literal runs past 15 + 255 and tiny blocks
+std::string logCompressionBlock(std::mt19937_64& random, std::size_t kind, std::size_t length) {
+    std::string block(length, '\0');
+    switch (kind) {
+        case 0:
+            for (char& c : block) {
+                c = static_cast<char>(random());
+            }
+            break;
+        case 1:
+            std::fill(block.begin(), block.end(), static_cast<char>(random()));
+            break;
+        case 2: {
+            std::size_t period = 1 + random() % 7;
+            for (std::size_t i = 0; i < length; ++i) {
+                block[i] = static_cast<char>('a' + (i % period));
+            }
+            break;
+        }
+        case 3: {
+            block.clear();
+            while (block.size() < length) {
+                block += "2026-10-17 12:00:0" + std::to_string(random() % 10) + " - API call finished url=https://api.example.com/" +
+                         std::to_string(random() % 50) + " status=200\n";
+            }
+            block.resize(length);
+            break;
+        }
+        default:
+            // Random stretches between repeats of earlier text
+            for (std::size_t i = 0; i < length; ++i) {
+                block[i] = i >= 64 && random() % 3 != 0 ? block[i - 1 - random() % 64] : static_cast<char>(random());
+            }
+            break;
+    }
+    return block;
+}
+
+// Round-trips blocks through lzblock, then compresses a log of mixed blocks into a .lz file and
+// reads it back through CompressedLogReader, seeking to and around every block boundary
+bool checkLogCompression(std::uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::size_t blocks = 0;
+    std::size_t stored = 0;
+    std::size_t failures = 0;
+    auto fail = [&failures](const std::string& what) {
+        if (++failures <= 5) {
+            std::cerr << "log-compression: " << what << std::endl;
+        }
+    };
+
+    static constexpr std::size_t kLengths[] = {0, 1, 3, 4, 5, 15, 16, 19, 270, 271, 1000, 4096, 65536, 70000};
+    std::string packed;
+    for (std::size_t kind = 0; kind < 5; ++kind) {
+        for (std::size_t length : kLengths) {
+            std::string block = logCompressionBlock(random, kind, length);
+            lzblock::compress(block.data(), block.size(), packed);
+            std::string unpacked(block.size(), '\0');
+            ++blocks;
+            stored += packed.size() >= block.size() ? 1 : 0;
+            if (!lzblock::decompress(packed.data(), packed.size(), unpacked.data(), unpacked.size()) || unpacked != block) {
+                fail("kind " + std::to_string(kind) + " block of " + std::to_string(length) + " bytes did not round-trip");
+            }
+        }
+    }
+    if (stored == 0) {
+        fail("no block came out as big as it went in, so none would be stored");
+    }
+
+    // Every block kind in turn, so the file mixes stored and compressed blocks
+    static constexpr std::uint32_t kBlockBytes = 4096;
+    std::filesystem::path path = std::filesystem::temp_directory_path() /
+                                 ("ve-selftest-" + std::to_string(seed) + "-" + std::to_string(::getpid()) + ".log");
+    std::string original;
+    for (std::size_t kind = 0; original.size() < 20 * kBlockBytes; ++kind) {
+        original += logCompressionBlock(random, kind % 5, kBlockBytes / 2 + random() % kBlockBytes);
+    }
+    std::size_t seeks = 0;
+    try {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(original.data(), static_cast<std::streamsize>(original.size()));
+        }
+        std::atomic<bool> stop{false};
+        std::string compressed = path.string() + kCompressedLogSuffix;
+        compressDataLog(path.string(), original.size(), compressed, kBlockBytes, stop);
+        if (std::filesystem::file_size(compressed) >= original.size()) {
+            fail("the .lz file did not come out smaller than the log, so no block in it is compressed");
+        }
+
+        CompressedLogReader reader(compressed);
+        std::istream in(&reader);
+        std::string whole((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (reader.rawSize() != original.size() || whole != original) {
+            fail("reading the whole .lz file gave " + std::to_string(whole.size()) + " bytes, not the original " +
+                 std::to_string(original.size()));
+        }
+        std::string span(kBlockBytes + 2, '\0');
+        for (std::size_t boundary = 0; boundary <= original.size(); boundary += kBlockBytes) {
+            for (std::size_t at : {boundary - 1, boundary, boundary + 1}) {
+                if (at > original.size()) {
+                    continue;
+                }
+                ++seeks;
+                in.clear();
+                in.seekg(static_cast<std::streamoff>(at));
+                in.read(span.data(), static_cast<std::streamsize>(span.size()));
+                std::string_view got(span.data(), static_cast<std::size_t>(in.gcount()));
+                if (got != std::string_view(original).substr(at, span.size())) {
+                    fail("reading after a seek to " + std::to_string(at) + " gave different bytes");
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        fail(e.what());
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(path.string() + kCompressedLogSuffix);
+
+    if (failures > 0) {
+        std::cerr << "FAIL log-compression: " << failures << " failures" << std::endl;
+        return false;
+    }
+    std::cout << "ok log-compression: " << blocks << " blocks round-tripped (" << stored << " stored), " << seeks
+              << " seeks into a .lz file" << std::endl;
+    return true;
+}
+
+void printUsage() {
+    std::cerr << "Usage: ve-selftest [--seed N] [--documents N]\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        std::uint64_t seed = 1;
+        std::size_t documents = 2000;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--seed" && hasValue) {
+                seed = std::stoull(argv[++i]);
+            } else if (arg == "--documents" && hasValue) {
+                documents = std::stoull(argv[++i]);
+            } else {
+                printUsage();
+                return 1;
+            }
+        }
+
+        bool passed = checkJsonStream(seed, documents);
+        passed = checkOAuthSigner() && passed;
+        passed = checkLogCompression(seed) && passed;
+        return passed ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Records how long each subsystem took to initialize, so a cold start can be broken down.
+// Subsystems initialize lazily and possibly on different threads, so recording is thread-safe.
+class StartupProfile {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static StartupProfile& instance() {
+        static StartupProfile profile;
+        return profile;
+    }
+
+    void record(const std::string& subsystem, Clock::duration duration) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        phases_.emplace_back(subsystem, duration);
+    }
+
+    // Run func, record its duration under subsystem and return its result
+    template<typename Func>
+    decltype(auto) measure(const std::string& subsystem, Func&& func) {
+        struct Recorder {
+            StartupProfile& profile;
+            const std::string& subsystem;
+            Clock::time_point start = Clock::now();
+            ~Recorder() { profile.record(subsystem, Clock::now() - start); }
+        } recorder{*this, subsystem};
+        return func();
+    }
+
+    void print(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto millis = [](Clock::duration duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        };
+        auto flags = out.flags();
+        out << "Startup profile:\n" << std::fixed << std::setprecision(3);
+        for (const auto& [subsystem, duration] : phases_) {
+            out << "  " << std::left << std::setw(24) << subsystem << std::right << std::setw(10) << millis(duration) << " ms\n";
+        }
+        out << "  " << std::left << std::setw(24) << "ready after" << std::right << std::setw(10) << millis(Clock::now() - origin_) << " ms\n";
+        out.flags(flags);
+    }
+
+private:
+    StartupProfile() : origin_(Clock::now()) {}
+
+    Clock::time_point origin_;
+    std::vector<std::pair<std::string, Clock::duration>> phases_;
+    mutable std::mutex mutex_;
+};
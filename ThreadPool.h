@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+enum class TaskPriority { HIGH, NORMAL, LOW };
+
+struct ThreadPoolOptions {
+    std::size_t threads = 0;       // 0 means one per hardware thread
+    std::size_t maxQueued = 4096;  // submitters wait once this many tasks are queued
+    bool pinThreads = false;       // pin worker i to the i-th CPU the process may run on (Linux)
+};
+
+// A fixed set of worker threads, each with its own task deques (one per TaskPriority). A worker
+// runs its own newest task first and, when out of work, steals the oldest task of the same
+// priority from another worker before looking at lower priorities, so higher-priority work is
+// picked up pool-wide first. Tasks submitted from a worker stay on that worker unless stolen.
+// The queue is bounded: outside submitters block when it is full, while a worker that submits
+// runs the task itself rather than wait on its own pool.
+//
+// A task should not block on a future of another task of the same pool, since every worker
+// could end up waiting that way.
+class ThreadPool {
+public:
+    static constexpr std::size_t kPriorities = 3;
+
+    struct Stats {
+        std::uint64_t executed = 0;
+        std::uint64_t stolen = 0;      // taken from another worker's deque
+        std::uint64_t ranInline = 0;   // submitted by a worker while the pool was full
+        std::size_t queued = 0;
+    };
+
+    explicit ThreadPool(const ThreadPoolOptions& options = ThreadPoolOptions()) : options_(options) {
+        std::size_t count = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t i = 0; i < count; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        threads_.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            threads_.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+    // Runs everything already queued, then joins the workers
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stopping_ = true;
+        }
+        sleepCv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // The process-wide pool every module's work runs on, created on first use
+    static ThreadPool& shared() {
+        static ThreadPool pool(sharedOptions());
+        return pool;
+    }
+
+    // Options for shared(); only has an effect before its first call
+    static void configureShared(const ThreadPoolOptions& options) {
+        sharedOptions() = options;
+    }
+
+    // Run f(args...) on the pool; the future yields its result or exception
+    template <typename F, typename... Args>
+    auto submit(F&& f, Args&&... args) {
+        return submit(TaskPriority::NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    template <typename F, typename... Args>
+    auto submit(TaskPriority priority, F&& f, Args&&... args) {
+        using Result = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(
+            [f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable {
+                return std::invoke(std::move(f), std::move(args)...);
+            });
+        std::future<Result> result = task->get_future();
+        enqueue(priority, [task]() { (*task)(); });
+        return result;
+    }
+
+    std::size_t size() const { return workers_.size(); }
+
+    Stats stats() const {
+        Stats stats;
+        stats.executed = executed_.load(std::memory_order_relaxed);
+        stats.stolen = stolen_.load(std::memory_order_relaxed);
+        stats.ranInline = ranInline_.load(std::memory_order_relaxed);
+        stats.queued = queued_.load();
+        return stats;
+    }
+
+private:
+    using Task = std::function<void()>;
+
+    struct Worker {
+        std::mutex mutex;
+        std::array<std::deque<Task>, kPriorities> queues;
+    };
+
+    ThreadPoolOptions options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> next_{0};   // round-robin target for outside submitters
+
+    std::atomic<std::size_t> queued_{0};
+    std::atomic<std::size_t> sleepers_{0};
+    std::atomic<std::size_t> blockedSubmitters_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCv_;  // workers waiting for tasks
+    std::condition_variable spaceCv_;  // submitters waiting for room
+    std::atomic<bool> stopping_{false};
+
+    std::atomic<std::uint64_t> executed_{0};
+    std::atomic<std::uint64_t> stolen_{0};
+    std::atomic<std::uint64_t> ranInline_{0};
+
+    static ThreadPoolOptions& sharedOptions() {
+        static ThreadPoolOptions options;
+        return options;
+    }
+
+    // The pool and worker index of the calling thread, if it is a worker
+    static ThreadPool*& currentPool() {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static std::size_t& currentIndex() {
+        thread_local std::size_t index = 0;
+        return index;
+    }
+
+    void enqueue(TaskPriority priority, Task task) {
+        bool onWorker = currentPool() == this;
+        if (queued_.load() >= options_.maxQueued) {
+            if (onWorker) {
+                ranInline_.fetch_add(1, std::memory_order_relaxed);
+                run(task);
+                return;
+            }
+            blockedSubmitters_.fetch_add(1);
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            spaceCv_.wait(lock, [this]() { return queued_.load() < options_.maxQueued || stopping_; });
+            blockedSubmitters_.fetch_sub(1);
+        }
+        if (stopping_ && !onWorker) {
+            throw std::runtime_error("ThreadPool is shutting down");
+        }
+
+        // Counted before it is pushed, so a worker that takes it never sees the count underflow.
+        // A worker going to sleep counts itself in sleepers_ before it checks queued_, so either
+        // it sees this task or this sees it and wakes it.
+        queued_.fetch_add(1);
+        std::size_t target = onWorker ? currentIndex() : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        Worker& worker = *workers_[target];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.queues[static_cast<std::size_t>(priority)].push_back(std::move(task));
+        }
+        if (sleepers_.load() > 0) {
+            { std::lock_guard<std::mutex> lock(sleepMutex_); }
+            sleepCv_.notify_one();
+        }
+    }
+
+    bool take(std::size_t self, Task& task) {
+        for (std::size_t priority = 0; priority < kPriorities; ++priority) {
+            {
+                Worker& own = *workers_[self];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                auto& queue = own.queues[priority];
+                if (!queue.empty()) {
+                    task = std::move(queue.back());
+                    queue.pop_back();
+                    return true;
+                }
+            }
+            for (std::size_t offset = 1; offset < workers_.size(); ++offset) {
+                Worker& victim = *workers_[(self + offset) % workers_.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                auto& queue = victim.queues[priority];
+                if (!queue.empty()) {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                    stolen_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work(std::size_t index) {
+        currentPool() = this;
+        currentIndex() = index;
+        if (options_.pinThreads) {
+            pin(index);
+        }
+        for (;;) {
+            Task task;
+            if (take(index, task)) {
+                queued_.fetch_sub(1);
+                if (blockedSubmitters_.load() > 0) {
+                    { std::lock_guard<std::mutex> lock(sleepMutex_); }
+                    spaceCv_.notify_one();
+                }
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            sleepers_.fetch_add(1);
+            sleepCv_.wait(lock, [this]() { return queued_.load() > 0 || stopping_; });
+            sleepers_.fetch_sub(1);
+            if (stopping_ && queued_.load() == 0) {
+                spaceCv_.notify_all();
+                return;
+            }
+        }
+    }
+
+    void run(Task& task) {
+        task(); // packaged_task keeps any exception for the future
+        executed_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void pin(std::size_t index) {
+#ifdef __linux__
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+            return;
+        }
+        std::size_t wanted = index % static_cast<std::size_t>(CPU_COUNT(&allowed));
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed) && wanted-- == 0) {
+                cpu_set_t one;
+                CPU_ZERO(&one);
+                CPU_SET(cpu, &one);
+                pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+                return;
+            }
+        }
+#else
+        (void)index;
+#endif
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+enum class TimestampPrecision {
+    SECONDS,      // 2024-11-27 04:50:58
+    MILLISECONDS, // 2024-11-27 04:50:58.123
+    MICROSECONDS  // 2024-11-27 04:50:58.123456
+};
+
+// Local-time "YYYY-MM-DD HH:MM:SS" timestamps without a stringstream or localtime per call.
+//
+// Each thread caches the formatted text of the last minute it saw. Within that minute only
+// the seconds and fraction digits are rewritten; localtime runs once per minute per thread.
+// Time zone offsets are assumed to be whole minutes, which holds for every zone in use today.
+class TimestampCache {
+public:
+    using Clock = std::chrono::system_clock;
+
+    static constexpr std::size_t kMaxLength = 26;
+
+    // Format timePoint into out, which must hold kMaxLength chars. Returns the length written.
+    static std::size_t format(Clock::time_point timePoint, TimestampPrecision precision, char* out) {
+        Cache& cache = threadCache();
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(timePoint.time_since_epoch()).count();
+        std::int64_t seconds = floorDiv(micros, 1000000);
+        std::int64_t fraction = micros - seconds * 1000000;
+        std::int64_t minute = floorDiv(seconds, 60);
+
+        if (minute != cache.minute) {
+            std::time_t time = static_cast<std::time_t>(seconds);
+            std::tm tm{};
+#ifdef _WIN32
+            localtime_s(&tm, &time);
+#else
+            localtime_r(&time, &tm);
+#endif
+            writeDigits(cache.text, tm.tm_year + 1900, 4);
+            cache.text[4] = '-';
+            writeDigits(cache.text + 5, tm.tm_mon + 1, 2);
+            cache.text[7] = '-';
+            writeDigits(cache.text + 8, tm.tm_mday, 2);
+            cache.text[10] = ' ';
+            writeDigits(cache.text + 11, tm.tm_hour, 2);
+            cache.text[13] = ':';
+            writeDigits(cache.text + 14, tm.tm_min, 2);
+            cache.text[16] = ':';
+            cache.minute = minute;
+            cache.second = -1;
+        }
+        if (seconds != cache.second) {
+            writeDigits(cache.text + 17, static_cast<int>(seconds - minute * 60), 2);
+            cache.second = seconds;
+        }
+
+        std::memcpy(out, cache.text, 19);
+        switch (precision) {
+            case TimestampPrecision::MILLISECONDS:
+                out[19] = '.';
+                writeDigits(out + 20, static_cast<int>(fraction / 1000), 3);
+                return 23;
+            case TimestampPrecision::MICROSECONDS:
+                out[19] = '.';
+                writeDigits(out + 20, static_cast<int>(fraction), 6);
+                return 26;
+            default:
+                return 19;
+        }
+    }
+
+    // Current time, formatted into a per-thread buffer that stays valid until the next call on this thread
+    static std::string_view now(TimestampPrecision precision = TimestampPrecision::SECONDS) {
+        return view(Clock::now(), precision);
+    }
+
+    // Like now(), for an arbitrary time point
+    static std::string_view view(Clock::time_point timePoint, TimestampPrecision precision = TimestampPrecision::SECONDS) {
+        char* buffer = threadCache().output;
+        return std::string_view(buffer, format(timePoint, precision, buffer));
+    }
+
+    static std::string toString(Clock::time_point timePoint, TimestampPrecision precision = TimestampPrecision::SECONDS) {
+        return std::string(view(timePoint, precision));
+    }
+
+private:
+    struct Cache {
+        std::int64_t minute = INT64_MIN;
+        std::int64_t second = -1;
+        char text[19];
+        char output[kMaxLength];
+    };
+
+    static Cache& threadCache() {
+        thread_local Cache cache;
+        return cache;
+    }
+
+    static std::int64_t floorDiv(std::int64_t value, std::int64_t divisor) {
+        std::int64_t quotient = value / divisor;
+        return (value % divisor < 0) ? quotient - 1 : quotient;
+    }
+
+    static void writeDigits(char* out, int value, int width) {
+        for (int i = width - 1; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+};
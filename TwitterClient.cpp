@@ -1,27 +1,35 @@
+#include <algorithm>
+#include <functional>
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <thread>
 #include <curl/curl.h>
 #include <json/json.h>
-#include <openssl/hmac.h>
-#include <openssl/sha.h>
-#include <ctime>
-#include <iomanip>
 #include <vector>
-#include <map>
+#include "OAuthSigner.h"
+#include "RequestScheduler.h"
+#include "ThreadPool.h"
 
 class TwitterClient {
 public:
-    TwitterClient(const std::string& consumerKey, const std::string& consumerSecret, const std::string& accessToken, const std::string& accessTokenSecret)
-        : consumerKey_(consumerKey), consumerSecret_(consumerSecret), accessToken_(accessToken), accessTokenSecret_(accessTokenSecret) {}
+    // Every request waits for scheduler to admit it under the route's rate limit. baseUrl can
+    // point the client elsewhere, e.g. at a local ve-mockhttp.
+    TwitterClient(const std::string& consumerKey, const std::string& consumerSecret, const std::string& accessToken, const std::string& accessTokenSecret,
+                  RequestScheduler& scheduler, const std::string& baseUrl = kDefaultBaseUrl)
+        : signer_(consumerKey, consumerSecret, accessToken, accessTokenSecret), scheduler_(scheduler), baseUrl_(baseUrl) {}
 
-    // Function to post a tweet
-    void postTweet(const std::string& status) {
-        std::string url = "https://api.twitter.com/1.1/statuses/update.json";
-        std::map<std::string, std::string> parameters;
-        parameters["status"] = status;
+    static constexpr const char* kDefaultBaseUrl = "https://api.twitter.com";
 
-        std::string authorizationHeader = generateAuthorizationHeader("POST", url, parameters);
+    // Rate-limit key of postTweet, for RequestScheduler::setLimit
+    static constexpr const char* kUpdateRoute = "POST statuses/update";
+
+    // Function to post a tweet; replies should pass RequestPriority::REPLY to go ahead of queued posts
+    void postTweet(const std::string& status, RequestPriority priority = RequestPriority::INTERACTIVE) {
+        std::string url = baseUrl_ + "/1.1/statuses/update.json";
+        scheduler_.acquire(kUpdateRoute, priority);
+
+        OAuthHeader authorizationHeader;
+        signer_.sign("POST", url, {{"status", status}}, authorizationHeader);
 
         CURL* curl = curl_easy_init();
         if (curl) {
@@ -29,7 +37,8 @@ public:
             headers = curl_slist_append(headers, authorizationHeader.c_str());
             headers = curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
 
-            std::string postFields = "status=" + curl_easy_escape(curl, status.c_str(), status.length());
+            std::string postFields = "status=";
+            OAuthSigner::appendEncoded(status, postFields);
 
             curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
             curl_easy_setopt(curl, CURLOPT_POST, 1L);
@@ -39,91 +48,27 @@ public:
             CURLcode res = curl_easy_perform(curl);
             if (res != CURLE_OK) {
                 std::cerr << "cURL error: " << curl_easy_strerror(res) << std::endl;
+            } else {
+                // Over the limit after all: hold the route back for as long as Twitter asked
+                long code = 0;
+                curl_off_t retryAfter = 0;
+                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+                curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter);
+                if (code == 429) {
+                    scheduler_.pause(kUpdateRoute, std::chrono::seconds(std::max<curl_off_t>(1, retryAfter)));
+                }
             }
 
+            curl_slist_free_all(headers);
             curl_easy_cleanup(curl);
         }
     }
 
 private:
-    std::string consumerKey_;
-    std::string consumerSecret_;
-    std::string accessToken_;
-    std::string accessTokenSecret_;
-
-    std::string urlEncode(const std::string& value) {
-        CURL* curl = curl_easy_init();
-        char* encoded = curl_easy_escape(curl, value.c_str(), value.length());
-        std::string result(encoded);
-        curl_free(encoded);
-        curl_easy_cleanup(curl);
-        return result;
-    }
-
-    std::string generateBaseString(const std::string& method, const std::string& url, const std::map<std::string, std::string>& parameters) {
-        std::stringstream ss;
-        ss << method << "&" << urlEncode(url) << "&";
-
-        std::vector<std::string> params;
-        for (const auto& param : parameters) {
-            params.push_back(urlEncode(param.first) + "=" + urlEncode(param.second));
-        }
-        std::sort(params.begin(), params.end());
-        for (size_t i = 0; i < params.size(); ++i) {
-            ss << params[i];
-            if (i < params.size() - 1) {
-                ss << "&";
-            }
-        }
-
-        return ss.str();
-    }
-
-    std::string calculateHMACSHA1(const std::string& data, const std::string& key) {
-        unsigned char hash[SHA_DIGEST_LENGTH];
-        HMAC_CTX* hmac = HMAC_CTX_new();
-        HMAC_Init_ex(hmac, key.c_str(), key.length(), EVP_sha1(), NULL);
-        HMAC_Update(hmac, (unsigned char*)data.c_str(), data.length());
-        unsigned int len = SHA_DIGEST_LENGTH;
-        HMAC_Final(hmac, hash, &len);
-        HMAC_CTX_free(hmac);
-
-        std::stringstream ss;
-        for (int i = 0; i < len; i++) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-        }
-        return ss.str();
-    }
+    OAuthSigner signer_;
+    RequestScheduler& scheduler_;
+    std::string baseUrl_;
 
-    std::string generateAuthorizationHeader(const std::string& method, const std::string& url, const std::map<std::string, std::string>& parameters) {
-        std::map<std::string, std::string> oauthParameters = {
-            {"oauth_consumer_key", consumerKey_},
-            {"oauth_nonce", std::to_string(time(NULL))},
-            {"oauth_signature_method", "HMAC-SHA1"},
-            {"oauth_timestamp", std::to_string(time(NULL))},
-            {"oauth_token", accessToken_},
-            {"oauth_version", "1.0"}
-        };
-
-        std::map<std::string, std::string> allParameters = oauthParameters;
-        allParameters.insert(parameters.begin(), parameters.end());
-
-        std::string baseString = generateBaseString(method, url, allParameters);
-        std::string signingKey = urlEncode(consumerSecret_) + "&" + urlEncode(accessTokenSecret_);
-        std::string signature = calculateHMACSHA1(baseString, signingKey);
-        oauthParameters["oauth_signature"] = signature;
-
-        std::stringstream ss;
-        ss << "Authorization: OAuth ";
-        for (auto it = oauthParameters.begin(); it != oauthParameters.end(); ++it) {
-            ss << urlEncode(it->first) << "=\"" << urlEncode(it->second) << "\"";
-            if (std::next(it) != oauthParameters.end()) {
-                ss << ", ";
-            }
-        }
-
-        return ss.str();
-    }
 };
 
 // Function to simulate posting a tweet
@@ -133,13 +78,23 @@ void simulateTweetPosting(TwitterClient& client, const std::vector<std::string>&
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --base-url URL sends the requests somewhere other than api.twitter.com
+    std::string baseUrl = TwitterClient::kDefaultBaseUrl;
+    if (argc == 3 && std::string(argv[1]) == "--base-url") {
+        baseUrl = argv[2];
+    }
+
     const std::string consumerKey = "your_consumer_key";
     const std::string consumerSecret = "your_consumer_secret";
     const std::string accessToken = "your_access_token";
     const std::string accessTokenSecret = "your_access_token_secret";
 
-    TwitterClient twitterClient(consumerKey, consumerSecret, accessToken, accessTokenSecret);
+    // statuses/update allows 300 posts per 3 hours
+    RequestScheduler scheduler;
+    scheduler.setLimit(TwitterClient::kUpdateRoute, RateLimit{300.0 / (3 * 3600), 5});
+
+    TwitterClient twitterClient(consumerKey, consumerSecret, accessToken, accessTokenSecret, scheduler, baseUrl);
 
     // List of tweets for simulation
     std::vector<std::string> tweets = {
@@ -148,9 +103,8 @@ int main() {
         "Building bots is fun!"
     };
 
-    // Simulate posting tweets in a separate thread
-    std::thread postThread(simulateTweetPosting, std::ref(twitterClient), std::cref(tweets));
-    postThread.join();
+    // Simulate posting tweets on the shared pool
+    ThreadPool::shared().submit(simulateTweetPosting, std::ref(twitterClient), std::cref(tweets)).get();
 
     return 0;
 }
\ No newline at end of file
@@ -1,29 +1,31 @@
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <curl/curl.h>
 #include <json/json.h>
-#include <openssl/hmac.h>
-#include <openssl/sha.h>
-#include <ctime>
-#include <iomanip>
 #include <vector>
-#include <map>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include "OAuthSigner.h"
+#include "ThreadPool.h"
 
 // Class to handle real-time data streaming from Twitter
 class TwitterStreamClient {
 public:
-    TwitterStreamClient(const std::string& consumerKey, const std::string& consumerSecret, const std::string& accessToken, const std::string& accessTokenSecret)
-        : consumerKey_(consumerKey), consumerSecret_(consumerSecret), accessToken_(accessToken), accessTokenSecret_(accessTokenSecret), terminate_(false) {}
+    // baseUrl can point the client elsewhere, e.g. at a local ve-mockhttp
+    TwitterStreamClient(const std::string& consumerKey, const std::string& consumerSecret, const std::string& accessToken, const std::string& accessTokenSecret,
+                        const std::string& baseUrl = kDefaultBaseUrl)
+        : signer_(consumerKey, consumerSecret, accessToken, accessTokenSecret), baseUrl_(baseUrl), terminate_(false) {}
+
+    static constexpr const char* kDefaultBaseUrl = "https://stream.twitter.com";
 
     // Function to start tracking real-time data
     void startTracking(const std::string& keywords) {
-        std::string url = "https://stream.twitter.com/1.1/statuses/filter.json?track=" + urlEncode(keywords);
+        std::string url = baseUrl_ + "/1.1/statuses/filter.json?track=";
+        OAuthSigner::appendEncoded(keywords, url);
 
-        std::string authorizationHeader = generateAuthorizationHeader("POST", url, {});
+        OAuthHeader authorizationHeader;
+        signer_.sign("POST", url, {}, authorizationHeader);
 
         CURL* curl = curl_easy_init();
         if (curl) {
@@ -61,89 +63,13 @@ public:
     }
 
 private:
-    std::string consumerKey_;
-    std::string consumerSecret_;
-    std::string accessToken_;
-    std::string accessTokenSecret_;
+    OAuthSigner signer_;
+    std::string baseUrl_;
     bool terminate_;
     std::thread streamingThread_;
     std::mutex mutex_;
     std::condition_variable cv_;
 
-    std::string urlEncode(const std::string& value) {
-        CURL* curl = curl_easy_init();
-        char* encoded = curl_easy_escape(curl, value.c_str(), value.length());
-        std::string result(encoded);
-        curl_free(encoded);
-        curl_easy_cleanup(curl);
-        return result;
-    }
-
-    std::string generateBaseString(const std::string& method, const std::string& url, const std::map<std::string, std::string>& parameters) {
-        std::stringstream ss;
-        ss << method << "&" << urlEncode(url) << "&";
-
-        std::vector<std::string> params;
-        for (const auto& param : parameters) {
-            params.push_back(urlEncode(param.first) + "=" + urlEncode(param.second));
-        }
-        std::sort(params.begin(), params.end());
-        for (size_t i = 0; i < params.size(); ++i) {
-            ss << params[i];
-            if (i < params.size() - 1) {
-                ss << "&";
-            }
-        }
-
-        return ss.str();
-    }
-
-    std::string calculateHMACSHA1(const std::string& data, const std::string& key) {
-        unsigned char hash[SHA_DIGEST_LENGTH];
-        HMAC_CTX* hmac = HMAC_CTX_new();
-        HMAC_Init_ex(hmac, key.c_str(), key.length(), EVP_sha1(), NULL);
-        HMAC_Update(hmac, (unsigned char*)data.c_str(), data.length());
-        unsigned int len = SHA_DIGEST_LENGTH;
-        HMAC_Final(hmac, hash, &len);
-        HMAC_CTX_free(hmac);
-
-        std::stringstream ss;
-        for (int i = 0; i < len; i++) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-        }
-        return ss.str();
-    }
-
-    std::string generateAuthorizationHeader(const std::string& method, const std::string& url, const std::map<std::string, std::string>& parameters) {
-        std::map<std::string, std::string> oauthParameters = {
-            {"oauth_consumer_key", consumerKey_},
-            {"oauth_nonce", std::to_string(time(NULL))},
-            {"oauth_signature_method", "HMAC-SHA1"},
-            {"oauth_timestamp", std::to_string(time(NULL))},
-            {"oauth_token", accessToken_},
-            {"oauth_version", "1.0"}
-        };
-
-        std::map<std::string, std::string> allParameters = oauthParameters;
-        allParameters.insert(parameters.begin(), parameters.end());
-
-        std::string baseString = generateBaseString(method, url, allParameters);
-        std::string signingKey = urlEncode(consumerSecret_) + "&" + urlEncode(accessTokenSecret_);
-        std::string signature = calculateHMACSHA1(baseString, signingKey);
-        oauthParameters["oauth_signature"] = signature;
-
-        std::stringstream ss;
-        ss << "Authorization: OAuth ";
-        for (auto it = oauthParameters.begin(); it != oauthParameters.end(); ++it) {
-            ss << urlEncode(it->first) << "=\"" << urlEncode(it->second) << "\"";
-            if (std::next(it) != oauthParameters.end()) {
-                ss << ", ";
-            }
-        }
-
-        return ss.str();
-    }
-
     static size_t writeCallback(void* contents, size_t size, size_t nmemb, void* userp) {
         ((TwitterStreamClient*)userp)->processData(std::string((char*)contents, size * nmemb));
         return size * nmemb;
@@ -165,19 +91,24 @@ void simulateTwitterStream(TwitterStreamClient& client, const std::string& keywo
     client.stopTracking();
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --base-url URL streams from somewhere other than stream.twitter.com
+    std::string baseUrl = TwitterStreamClient::kDefaultBaseUrl;
+    if (argc == 3 && std::string(argv[1]) == "--base-url") {
+        baseUrl = argv[2];
+    }
+
     const std::string consumerKey = "your_consumer_key";
     const std::string consumerSecret = "your_consumer_secret";
     const std::string accessToken = "your_access_token";
     const std::string accessTokenSecret = "your_access_token_secret";
 
-    TwitterStreamClient twitterClient(consumerKey, consumerSecret, accessToken, accessTokenSecret);
+    TwitterStreamClient twitterClient(consumerKey, consumerSecret, accessToken, accessTokenSecret, baseUrl);
 
     std::string keywords = "example, test"; // Specify the keywords to track
 
-    // Start and stop the Twitter stream in a separate thread
-    std::thread streamThread(simulateTwitterStream, std::ref(twitterClient), std::cref(keywords));
-    streamThread.join();
+    // Start and stop the Twitter stream on the shared pool
+    ThreadPool::shared().submit(simulateTwitterStream, std::ref(twitterClient), std::cref(keywords)).get();
 
     return 0;
 }
\ No newline at end of file
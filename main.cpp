@@ -1,79 +1,384 @@
 #include <iostream>
+#include <iomanip>
+#include <string>
 #include <chrono>
 #include <thread>
 #include <vector>
 #include <random>
 #include <ctime>
-#include <unordered_set>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
 #include <utility>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include "QaCorpusFile.h"
+#include "StartupProfile.h"
+#include "BenchmarkSupport.h"
+#include "ThreadPool.h"
 
-// Function to simulate a delay of 2 seconds
-void delay() {
-    std::this_thread::sleep_for(std::chrono::seconds(2));
+// Clock the simulation is paced by. The real clock sleeps; the virtual clock only
+// advances a counter, so benchmark runs are not bounded by the pacing delays.
+class SimulationClock {
+public:
+    explicit SimulationClock(bool isVirtual = false) : virtual_(isVirtual) {}
+
+    // Simulate a delay, 2 seconds by default
+    void delay(std::chrono::nanoseconds duration = std::chrono::seconds(2)) {
+        if (virtual_) {
+            elapsed_ += duration;
+        } else {
+            std::this_thread::sleep_for(duration);
+        }
+    }
+
+    std::chrono::nanoseconds virtualElapsed() const { return elapsed_; }
+
+private:
+    bool virtual_;
+    std::chrono::nanoseconds elapsed_{0};
+};
+
+// Immutable question/answer corpus, built once and shared for the whole run.
+// It is either compiled in or a memory-mapped corpus file; entries are views either way.
+class QaCorpus {
+public:
+    using Entry = std::pair<std::string_view, std::string_view>;
+
+    explicit QaCorpus(std::vector<Entry> entries) : entries_(std::move(entries)) {}
+    explicit QaCorpus(const std::string& path) : file_(std::make_unique<QaCorpusFile>(path)) {}
+
+    // The corpus compiled into the binary
+    static const QaCorpus& builtin() {
+        static const QaCorpus corpus({
+            {"What's the weather like today?", "It's sunny and warm!"},
+            {"How do I improve my coding skills?", "Practice, practice, and more practice."},
+            {"What's the best way to learn C++?", "Start with the basics and build projects."},
+            {"Can you tell me a joke?", "Why did the scarecrow win an award? Because he was outstanding in his field!"},
+            {"What's the meaning of life?", "42 is the answer to the ultimate question of life, the universe, and everything."},
+            {"What is photosynthesis?", "Photosynthesis is the process used by plants to convert light energy into chemical energy."},
+            {"How does gravity work?", "Gravity is a force by which a planet or other body draws objects toward its center."},
+            {"Who was Albert Einstein?", "Albert Einstein was a theoretical physicist who developed the theory of relativity."},
+            {"What is the speed of light?", "The speed of light in a vacuum is approximately 299,792 kilometers per second."},
+            {"Can you explain quantum mechanics?", "Quantum mechanics is a fundamental theory in physics describing the properties of nature on an atomic scale."},
+            {"What causes a rainbow?", "A rainbow is caused by reflection, refraction, and dispersion of light in water droplets."},
+            {"What is DNA?", "DNA is a molecule that carries genetic instructions used in the growth, development, and functioning of all living organisms."},
+            {"What is the Big Bang Theory?", "The Big Bang Theory is the prevailing cosmological model explaining the universe's origin from a singularity."},
+            {"How does a computer work?", "A computer processes data through the use of integrated circuits, memory, storage, and input/output devices."},
+            {"What are black holes?", "Black holes are regions of spacetime exhibiting gravitational acceleration so strong that nothing can escape from them."}
+        });
+        return corpus;
+    }
+
+    std::size_t size() const { return file_ ? file_->size() : entries_.size(); }
+
+    Entry operator[](std::size_t index) const {
+        if (file_) {
+            return {file_->question(index), file_->answer(index)};
+        }
+        return entries_[index];
+    }
+
+private:
+    std::vector<Entry> entries_;
+    std::unique_ptr<QaCorpusFile> file_;
+};
+
+// Draws indices in [0, size) without repetition at constant cost per draw.
+// This is a Fisher-Yates shuffle materialised lazily: a slot whose stamp does not
+// match the current epoch still holds its identity value, so starting a new epoch
+// is O(1) instead of rewriting the whole permutation.
+class NonRepeatingSampler {
+public:
+    NonRepeatingSampler(std::size_t size, std::uint64_t seed)
+        : size_(size), permutation_(size), stamps_(size), generator_(seed) {
+        if (size > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("Corpus too large for sampler");
+        }
+    }
+
+    std::size_t size() const { return size_; }
+    std::size_t remaining() const { return size_ - drawn_; }
+    bool exhausted() const { return drawn_ == size_; }
+
+    std::size_t next() {
+        if (exhausted()) {
+            throw std::out_of_range("Sampler exhausted; call reset() to start a new epoch");
+        }
+        std::uniform_int_distribution<std::size_t> distribution(drawn_, size_ - 1);
+        std::size_t pick = distribution(generator_);
+
+        std::uint32_t chosen = slot(pick);
+        store(pick, slot(drawn_));
+        store(drawn_, chosen);
+        ++drawn_;
+        return chosen;
+    }
+
+    // Start a new epoch; every index becomes available again
+    void reset() {
+        drawn_ = 0;
+        if (++epoch_ == 0) {
+            // Stamps wrapped around, so old entries could look current again
+            std::fill(stamps_.begin(), stamps_.end(), 0);
+            epoch_ = 1;
+        }
+    }
+
+    // Start a new epoch with a fresh random stream
+    void reseed(std::uint64_t seed) {
+        generator_.seed(seed);
+        reset();
+    }
+
+private:
+    std::size_t size_;
+    std::size_t drawn_ = 0;
+    std::uint32_t epoch_ = 1;
+    std::vector<std::uint32_t> permutation_;
+    std::vector<std::uint32_t> stamps_;
+    std::mt19937_64 generator_;
+
+    std::uint32_t slot(std::size_t index) const {
+        return stamps_[index] == epoch_ ? permutation_[index] : static_cast<std::uint32_t>(index);
+    }
+
+    void store(std::size_t index, std::uint32_t value) {
+        permutation_[index] = value;
+        stamps_[index] = epoch_;
+    }
+};
+
+// Stages of one simulation cycle, in the order they run
+enum class Stage {
+    TWEET,
+    QUESTION,
+    ANSWER,
+    COUNT
+};
+
+const char* stageToString(Stage stage) {
+    switch (stage) {
+        case Stage::TWEET: return "tweet";
+        case Stage::QUESTION: return "question";
+        case Stage::ANSWER: return "answer";
+        default: return "unknown";
+    }
 }
 
-// Function to get a random question and answer pair
-std::pair<std::string, std::string> getRandomQuestionAndAnswer(std::unordered_set<int>& askedIndices) {
-    std::vector<std::pair<std::string, std::string>> qaPairs = {
-        {"What's the weather like today?", "It's sunny and warm!"},
-        {"How do I improve my coding skills?", "Practice, practice, and more practice."},
-        {"What's the best way to learn C++?", "Start with the basics and build projects."},
-        {"Can you tell me a joke?", "Why did the scarecrow win an award? Because he was outstanding in his field!"},
-        {"What's the meaning of life?", "42 is the answer to the ultimate question of life, the universe, and everything."},
-        {"What is photosynthesis?", "Photosynthesis is the process used by plants to convert light energy into chemical energy."},
-        {"How does gravity work?", "Gravity is a force by which a planet or other body draws objects toward its center."},
-        {"Who was Albert Einstein?", "Albert Einstein was a theoretical physicist who developed the theory of relativity."},
-        {"What is the speed of light?", "The speed of light in a vacuum is approximately 299,792 kilometers per second."},
-        {"Can you explain quantum mechanics?", "Quantum mechanics is a fundamental theory in physics describing the properties of nature on an atomic scale."},
-        {"What causes a rainbow?", "A rainbow is caused by reflection, refraction, and dispersion of light in water droplets."},
-        {"What is DNA?", "DNA is a molecule that carries genetic instructions used in the growth, development, and functioning of all living organisms."},
-        {"What is the Big Bang Theory?", "The Big Bang Theory is the prevailing cosmological model explaining the universe's origin from a singularity."},
-        {"How does a computer work?", "A computer processes data through the use of integrated circuits, memory, storage, and input/output devices."},
-        {"What are black holes?", "Black holes are regions of spacetime exhibiting gravitational acceleration so strong that nothing can escape from them."}
-    };
+// Run one tweet -> question -> answer cycle; onStageEnd is called as each stage completes
+template<typename OnStageEnd>
+void runCycle(const QaCorpus& corpus, NonRepeatingSampler& sampler, std::ostream& out,
+              SimulationClock& clock, OnStageEnd&& onStageEnd) {
+    out << "[*] Tweet: \"Ask me anything! [??]\"" << std::endl;
+    onStageEnd(Stage::TWEET);
+    clock.delay();
 
-    static std::mt19937 generator(static_cast<unsigned int>(std::time(nullptr)));
+    auto [question, answer] = corpus[sampler.next()];
+    out << "[?] User: \"" << question << "\" [?]" << std::endl;
+    onStageEnd(Stage::QUESTION);
+    clock.delay();
 
-    std::uniform_int_distribution<int> distribution(0, qaPairs.size() - 1);
-    int index;
-    do {
-        index = distribution(generator);
-    } while (askedIndices.find(index) != askedIndices.end());
+    out << "[!] Virtual Engine: \"" << answer << "\" [!]" << std::endl;
+    onStageEnd(Stage::ANSWER);
+    clock.delay();
 
-    askedIndices.insert(index);
-    return qaPairs[index];
+    out << "-------------------------------------\n" << std::endl;
+    clock.delay();
 }
 
-int main() {
-    // Add two blank lines at the top
-    std::cout << "\n\n";
+struct BenchOptions {
+    std::uint64_t iterations = 1000000;
+    double rate = 0.0; // cycles per second; 0 runs at maximum speed
+    std::uint64_t seed = 42;
+};
+
+struct Options {
+    bool bench = false;
+    bool fastStart = false; // skip the start-up effect and print the startup profile
+    BenchOptions benchOptions;
+    std::string corpusPath; // empty uses the built-in corpus
+};
 
-    // Start-up effect
-    std::cout << "Initializing Virtual Engine";
-    for (int i = 0; i < 3; ++i) {
-        std::cout << "." << std::flush;
-        delay();
+// Everything the simulation needs before its first cycle
+struct EngineState {
+    std::unique_ptr<QaCorpus> loadedCorpus;
+    const QaCorpus* corpus = nullptr;
+    std::unique_ptr<NonRepeatingSampler> sampler;
+};
+
+// Map the corpus and size the sampler, recording each step in the startup profile
+EngineState initializeEngine(const Options& options, std::uint64_t seed) {
+    StartupProfile& profile = StartupProfile::instance();
+    EngineState state;
+
+    profile.measure("corpus", [&]() {
+        if (!options.corpusPath.empty()) {
+            state.loadedCorpus = std::make_unique<QaCorpus>(options.corpusPath);
+        }
+        state.corpus = state.loadedCorpus ? state.loadedCorpus.get() : &QaCorpus::builtin();
+    });
+    if (state.corpus->size() == 0) {
+        throw std::runtime_error("Corpus is empty");
     }
-    std::cout << "\rVirtual Engine Initialized! [*]\n" << std::endl;
 
-    std::unordered_set<int> askedIndices;
+    profile.measure("sampler", [&]() {
+        state.sampler = std::make_unique<NonRepeatingSampler>(state.corpus->size(), seed);
+    });
+    return state;
+}
+
+// Run the simulation headless on a virtual clock and report throughput and per-stage latency.
+// With a target rate, each cycle's latency is measured from when it was scheduled to start,
+// so falling behind the schedule shows up in the numbers instead of being hidden.
+int runBenchmark(const QaCorpus& corpus, NonRepeatingSampler& sampler, const BenchOptions& options) {
+    using Clock = std::chrono::steady_clock;
 
-    // Simulation loop
-    while (askedIndices.size() < 15) {
-        std::cout << "[*] Tweet: \"Ask me anything! [??]\"" << std::endl;
-        delay();
+    NullBuffer nullBuffer;
+    std::ostream out(&nullBuffer);
+    SimulationClock clock(true);
+
+    constexpr std::size_t stageCount = static_cast<std::size_t>(Stage::COUNT);
+    std::vector<LatencyRecorder> stageLatencies(stageCount);
+    LatencyRecorder cycleLatencies;
+    for (auto& recorder : stageLatencies) {
+        recorder.reserve(options.iterations);
+    }
+    cycleLatencies.reserve(options.iterations);
 
-        auto [question, answer] = getRandomQuestionAndAnswer(askedIndices);
-        std::cout << "[?] User: \"" << question << "\" [?]" << std::endl;
-        delay();
+    auto start = Clock::now();
+    for (std::uint64_t i = 0; i < options.iterations; ++i) {
+        auto cycleStart = Clock::now();
+        if (options.rate > 0.0) {
+            auto due = start + std::chrono::nanoseconds(static_cast<std::int64_t>(static_cast<double>(i) * 1e9 / options.rate));
+            while (cycleStart < due) {
+                std::this_thread::yield();
+                cycleStart = Clock::now();
+            }
+            cycleStart = due;
+        }
+        if (sampler.exhausted()) {
+            sampler.reset();
+        }
 
-        std::cout << "[!] Virtual Engine: \"" << answer << "\" [!]" << std::endl;
-        delay();
+        auto stageStart = Clock::now();
+        runCycle(corpus, sampler, out, clock, [&](Stage stage) {
+            auto now = Clock::now();
+            stageLatencies[static_cast<std::size_t>(stage)].record(now - stageStart);
+            stageStart = now;
+        });
+        cycleLatencies.record(Clock::now() - cycleStart);
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::cout << "Benchmark: " << options.iterations << " cycles in " << std::fixed << std::setprecision(3)
+              << elapsed.count() << " s (" << std::setprecision(0)
+              << static_cast<double>(options.iterations) / elapsed.count() << " cycles/s, target "
+              << (options.rate > 0.0 ? std::to_string(static_cast<std::uint64_t>(options.rate)) + " cycles/s" : "max")
+              << ")\n";
+    std::cout << "Virtual time simulated: "
+              << std::chrono::duration_cast<std::chrono::seconds>(clock.virtualElapsed()).count() << " s\n";
 
-        std::cout << "-------------------------------------\n" << std::endl;
-        delay();
+    std::cout << std::left << std::setw(10) << "stage" << std::right
+              << std::setw(12) << "p50 (ns)" << std::setw(12) << "p99 (ns)"
+              << std::setw(12) << "p999 (ns)" << std::setw(12) << "max (ns)" << "\n";
+    auto printRow = [](const char* name, LatencyRecorder& recorder) {
+        std::cout << std::left << std::setw(10) << name << std::right
+                  << std::setw(12) << recorder.percentile(0.50) << std::setw(12) << recorder.percentile(0.99)
+                  << std::setw(12) << recorder.percentile(0.999) << std::setw(12) << recorder.percentile(1.0) << "\n";
+    };
+    for (std::size_t stage = 0; stage < stageCount; ++stage) {
+        printRow(stageToString(static_cast<Stage>(stage)), stageLatencies[stage]);
+    }
+    printRow("cycle", cycleLatencies);
+    std::cout << std::flush;
+    return 0;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--fast-start] [--corpus FILE.qac] [--bench [--iterations N] [--rate CYCLES_PER_SEC] [--seed N]]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    StartupProfile& profile = StartupProfile::instance();
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument(std::string(arg) + " requires a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--bench") {
+                options.bench = true;
+            } else if (arg == "--fast-start") {
+                options.fastStart = true;
+            } else if (arg == "--corpus") {
+                options.corpusPath = value();
+            } else if (arg == "--iterations") {
+                options.benchOptions.iterations = std::stoull(value());
+            } else if (arg == "--rate") {
+                options.benchOptions.rate = std::stod(value());
+            } else if (arg == "--seed") {
+                options.benchOptions.seed = std::stoull(value());
+            } else {
+                throw std::invalid_argument("Unknown option " + std::string(arg));
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Bring the engine up on the shared pool so it overlaps with the start-up effect
+    std::uint64_t seed = options.bench ? options.benchOptions.seed : static_cast<std::uint64_t>(std::time(nullptr));
+    auto startup = ThreadPool::shared().submit(TaskPriority::HIGH, initializeEngine, std::cref(options), seed);
+
+    SimulationClock clock;
+    if (!options.bench) {
+        // Add two blank lines at the top
+        std::cout << "\n\n";
+
+        // Start-up effect
+        std::cout << "Initializing Virtual Engine";
+        if (!options.fastStart) {
+            for (int i = 0; i < 3; ++i) {
+                std::cout << "." << std::flush;
+                clock.delay();
+            }
+        }
+    }
+
+    EngineState engine;
+    try {
+        engine = startup.get();
+    } catch (const std::exception& e) {
+        std::cerr << "\nException: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (options.bench) {
+        if (options.fastStart) {
+            profile.print(std::cout);
+        }
+        return runBenchmark(*engine.corpus, *engine.sampler, options.benchOptions);
+    }
+    std::cout << "\rVirtual Engine Initialized! [*]\n" << std::endl;
+    if (options.fastStart) {
+        profile.print(std::cout);
+        std::cout << std::endl;
+    }
+
+    // Simulation loop
+    while (!engine.sampler->exhausted()) {
+        runCycle(*engine.corpus, *engine.sampler, std::cout, clock, [](Stage) {});
     }
 
     std::cout << "All questions have been asked. Ending simulation." << std::endl;
     return 0;
-}
\ No newline at end of file
+}